@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Insert/lookup throughput of the core hashtable with string keys, as the
+// compiler uses it for symbol and type tables. Build with `make hashbench`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "core/hashtable.h"
+
+static double getms()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static void run(int n)
+{
+    char **keys = malloc(n * sizeof(char *));
+    int i;
+    for(i = 0; i < n; i++)
+    {
+        keys[i] = malloc(24);
+        sprintf(keys[i], "__egl_sym_%d", i);
+    }
+
+    // Keep the total work roughly constant across sizes
+    int rounds = 1000000 / n;
+    if(rounds < 1)
+        rounds = 1;
+
+    double put = 0, hit = 0, miss = 0;
+    long found = 0;
+    int r;
+    for(r = 0; r < rounds; r++)
+    {
+        Hashtable ht = hst_create();
+        ht.duplicate_keys = 1;
+
+        double start = getms();
+        for(i = 0; i < n; i++)
+            hst_put(&ht, keys[i], keys[i], NULL, NULL);
+        double mid = getms();
+        for(i = 0; i < n; i++)
+            found += hst_get(&ht, keys[i], NULL, NULL) != NULL;
+        double end = getms();
+        for(i = 0; i < n; i++)
+            found += hst_get(&ht, keys[i] + 1, NULL, NULL) != NULL;
+
+        put += mid - start;
+        hit += end - mid;
+        miss += getms() - end;
+
+        hst_free(&ht);
+    }
+
+    double ops = (double)n * rounds / 1000.0;
+    printf("%9d keys  put %7.1f ns/op  hit %7.1f ns/op  miss %7.1f ns/op  (%ld)\n",
+           n, put * 1e3 / ops, hit * 1e3 / ops, miss * 1e3 / ops, found);
+
+    for(i = 0; i < n; i++)
+        free(keys[i]);
+    free(keys);
+}
+
+int main()
+{
+    int n;
+    for(n = 1000; n <= 1000000; n *= 10)
+        run(n);
+
+    return 0;
+}
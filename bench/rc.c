@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Cost of reference counting in the code eagle generates, with threads
+// taking and dropping references to either one shared object or an object
+// each. The counting itself is in bench/rc.egl; `make rcbench` compiles it
+// with --rc=local and --rc=atomic and links each against the matching
+// runtime object, giving rcbench-local and rcbench-atomic.
+//
+// Local counts are not safe to share between threads. To keep the shared
+// runs from freeing the object while they lose updates, its count gets a
+// cushion larger than the number of operations; whatever the count drifts
+// from that is reported.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifndef RC_MODE
+#define RC_MODE "local"
+#endif
+
+#define ROUNDS 10000000
+#define MAX_THREADS 8
+#define CUSHION (1 << 30)
+
+// Layout of RCBenchSlot, one per cache line
+typedef struct {
+    void *held;
+    char pad[64 - sizeof(void *)];
+} Slot;
+
+typedef struct {
+    Slot *from;
+    Slot *slot;
+} Worker;
+
+void rcbench_new(Slot *owner);
+void rcbench_drop(Slot *owner);
+void rcbench_pairs(Slot *from, Slot *slot, long rounds);
+
+static double getms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static Slot *make_slots(int count)
+{
+    void *slots;
+    if(posix_memalign(&slots, 64, count * sizeof(Slot)))
+        abort();
+
+    memset(slots, 0, count * sizeof(Slot));
+    return slots;
+}
+
+// The count is the first field of every counted object
+static int *count_of(Slot *owner)
+{
+    return owner->held;
+}
+
+static void *work(void *data)
+{
+    Worker *w = data;
+    rcbench_pairs(w->from, w->slot, ROUNDS);
+
+    return NULL;
+}
+
+static void run(int threads, int shared)
+{
+    Slot *owners = make_slots(threads);
+    Slot *slots = make_slots(threads);
+    Worker workers[MAX_THREADS];
+    pthread_t ids[MAX_THREADS];
+
+    int i;
+    for(i = 0; i < threads; i++)
+    {
+        if(!shared || !i)
+        {
+            rcbench_new(owners + i);
+            *count_of(owners + i) += CUSHION;
+        }
+
+        workers[i].from = shared ? owners : owners + i;
+        workers[i].slot = slots + i;
+    }
+
+    double start = getms();
+    for(i = 0; i < threads; i++)
+        pthread_create(ids + i, NULL, work, workers + i);
+    for(i = 0; i < threads; i++)
+        pthread_join(ids[i], NULL);
+    double ms = getms() - start;
+
+    long drift = 0;
+    for(i = 0; i < (shared ? 1 : threads); i++)
+    {
+        *count_of(owners + i) -= CUSHION;
+        drift += *count_of(owners + i) - 1;
+        rcbench_drop(owners + i);
+    }
+
+    // One increment and one decrement per round, on every thread
+    printf("%-6s %d thread%s %-7s %7.2f ns/op  count drift %ld\n", RC_MODE,
+           threads, threads == 1 ? " " : "s", shared ? "shared" : "private",
+           ms * 1e6 / (2.0 * ROUNDS * threads), drift);
+
+    free(owners);
+    free(slots);
+}
+
+int main()
+{
+    int threads;
+    for(threads = 1; threads <= MAX_THREADS; threads *= 2)
+    {
+        run(threads, 0);
+        if(threads > 1)
+            run(threads, 1);
+    }
+
+    return 0;
+}
@@ -76,8 +76,7 @@ void ac_prepare_methods_each(void *key, void *val, void *data)
 
     char *method_name = ac_gen_method_name(cd->name, fd->ident);
 
-    ety->params[0] = ett_pointer_type(ett_struct_type(cd->name));
-    ((EaglePointerType *)ety->params[0])->counted = 1;
+    ety->params[0] = ett_pointer_type_ex(ett_struct_type(cd->name), 1, 0, 0);
     LLVMTypeRef ft = ett_llvm_type((EagleComplexType *)ety);
 
     LLVMValueRef func = LLVMAddFunction(h->cb->module, method_name, ft);
@@ -102,8 +101,7 @@ void ac_class_add_early_definitions(ASTClassDecl *cd, CompilerBundle *cb, ClassH
     char *method_name = ac_gen_method_name(cd->name, (char *)"__init__");
 
     EagleFunctionType *ety = (EagleFunctionType *)cd->inittype;
-    ety->params[0] = ett_pointer_type(ett_struct_type(cd->name));
-    ((EaglePointerType *)ety->params[0])->counted = 1;
+    ety->params[0] = ett_pointer_type_ex(ett_struct_type(cd->name), 1, 0, 0);
     LLVMTypeRef ft = ett_llvm_type((EagleComplexType *)ety);
     LLVMValueRef func = LLVMAddFunction(cb->module, method_name, ft);
     if(h->linkage == VLLocal && !cd->ext)
@@ -145,8 +143,7 @@ void ac_compile_class_destruct(ASTClassDecl *cd, CompilerBundle *cb)
     char *method_name = ac_gen_method_name(cd->name, (char *)"__destruct__");
 
     EagleFunctionType *ety = (EagleFunctionType *)cd->destructtype;
-    ety->params[0] = ett_pointer_type(ett_struct_type(cd->name));
-    ((EaglePointerType *)ety->params[0])->counted = 1;
+    ety->params[0] = ett_pointer_type_ex(ett_struct_type(cd->name), 1, 0, 0);
     LLVMTypeRef ft = ett_llvm_type((EagleComplexType *)ety);
     LLVMValueRef func = LLVMAddFunction(cb->module, method_name, ft);
 
@@ -212,6 +209,73 @@ void ac_compile_class_methods_each(void *key, void *val, void *data)
         ac_check_and_register_implementation(fd->ident, h, cd->name, func, cd);
 }
 
+#define ITABLE_MAX_SIZE 1024
+
+// Lays out the class's itable so that each interface id lands in its own
+// slot when masked. Interface calls then find their method block with a
+// single indexed load; an id that still collides at the maximum size is
+// left out and resolved through __egl_lookup_method instead.
+static LLVMValueRef ac_make_class_itable(ASTClassDecl *a, CompilerBundle *cb, LLVMValueRef ptrs, long *mask)
+{
+    int count = (int)a->interfaces.count;
+    unsigned long ids[count];
+    int i, j;
+    for(i = 0; i < count; i++)
+        ids[i] = ty_interface_id(a->interfaces.items[i]);
+
+    int size;
+    for(size = 1; size < count; size <<= 1);
+    for(; size < ITABLE_MAX_SIZE; size <<= 1)
+    {
+        int collides = 0;
+        for(i = 0; i < count && !collides; i++)
+            for(j = i + 1; j < count && !collides; j++)
+                collides = (ids[i] & (size - 1)) == (ids[j] & (size - 1));
+
+        if(!collides)
+            break;
+    }
+
+    LLVMTypeRef enttype = ty_class_itable_entry();
+    LLVMTypeRef fnstype = LLVMPointerType(LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0), 0);
+    LLVMValueRef slots[size];
+    for(i = 0; i < size; i++)
+        slots[i] = NULL;
+
+    int offset = 0;
+    for(i = 0; i < count; i++)
+    {
+        int slot = (int)(ids[i] & (size - 1));
+        if(!slots[slot])
+        {
+            LLVMValueRef idx[] = {
+                LLVMConstInt(LLVMInt32TypeInContext(utl_get_current_context()), 0, 0),
+                LLVMConstInt(LLVMInt32TypeInContext(utl_get_current_context()), offset, 0)
+            };
+
+            LLVMValueRef vals[] = {
+                LLVMConstInt(LLVMInt64TypeInContext(utl_get_current_context()), ids[i], 0),
+                LLVMConstBitCast(LLVMConstGEP(ptrs, idx, 2), fnstype)
+            };
+            slots[slot] = LLVMConstNamedStruct(enttype, vals, 2);
+        }
+
+        offset += ty_interface_count(a->interfaces.items[i]);
+    }
+
+    for(i = 0; i < size; i++) if(!slots[i])
+        slots[i] = LLVMConstNull(enttype);
+
+    char *itable_name = ac_gen_ifc_internal_name(a->name, 'i');
+    LLVMValueRef itable = LLVMAddGlobal(cb->module, LLVMArrayType(enttype, size), itable_name);
+    LLVMSetInitializer(itable, LLVMConstArray(enttype, slots, size));
+    LLVMSetGlobalConstant(itable, 1);
+    free(itable_name);
+
+    *mask = size - 1;
+    return itable;
+}
+
 void ac_make_class_definitions(AST *ast, CompilerBundle *cb)
 {
     AST *old = ast;
@@ -324,12 +388,17 @@ void ac_make_class_definitions(AST *ast, CompilerBundle *cb)
             LLVMSetInitializer(ptrs, initptrs);
             free(h.interface_pointers);
 
+            long mask;
+            LLVMValueRef itable = ac_make_class_itable(a, cb, ptrs, &mask);
+
             LLVMValueRef z = LLVMConstInt(LLVMInt32TypeInContext(utl_get_current_context()), 0, 0);
             LLVMValueRef indirvals[] = {
                 LLVMConstInt(LLVMInt32TypeInContext(utl_get_current_context()), (int)a->interfaces.count, 0),
                 LLVMConstGEP(constnames, &z, 1),
                 LLVMConstGEP(offsets, &z, 1),
-                LLVMConstGEP(ptrs, &z, 1)
+                LLVMConstGEP(ptrs, &z, 1),
+                LLVMConstInt(LLVMInt64TypeInContext(utl_get_current_context()), mask, 0),
+                LLVMConstGEP(itable, &z, 1)
             };
 
 #ifdef llvm_OLD
@@ -338,8 +407,9 @@ void ac_make_class_definitions(AST *ast, CompilerBundle *cb)
             indirvals[2] = LLVMConstBitCast(indirvals[2], LLVMPointerType(LLVMInt64TypeInContext(utl_get_current_context()), 0));
             indirvals[3] = LLVMConstBitCast(indirvals[3], LLVMPointerType(LLVMPointerType(
                 LLVMInt8TypeInContext(utl_get_current_context()), 0), 0));
+            indirvals[5] = LLVMConstBitCast(indirvals[5], LLVMPointerType(ty_class_itable_entry(), 0));
 #endif
-            LLVMValueRef vtableinit = LLVMConstNamedStruct(indirtype, indirvals, 4);
+            LLVMValueRef vtableinit = LLVMConstNamedStruct(indirtype, indirvals, 6);
 
             LLVMSetInitializer(vtable, vtableinit);
         }
@@ -409,14 +479,13 @@ void ac_make_class_destructor(AST *ast, CompilerBundle *cb)
     LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(utl_get_current_context(), func, "entry");
     LLVMPositionBuilderAtEnd(cb->builder, entry);
 
-    EaglePointerType *ett = (EaglePointerType *)ett_pointer_type(ett_struct_type(a->name));
-    LLVMValueRef pos = LLVMBuildAlloca(cb->builder, ett_llvm_type((EagleComplexType *)ett), "");
+    EagleComplexType *ett = ett_pointer_type(ett_struct_type(a->name));
+    EagleComplexType *cett = ett_pointer_type_ex(ett_struct_type(a->name), 1, 0, 0);
+    LLVMValueRef pos = LLVMBuildAlloca(cb->builder, ett_llvm_type(ett), "");
 
     if(a->destructdecl)
     {
-        ett->counted = 1;
-        LLVMValueRef me = LLVMBuildBitCast(cb->builder, LLVMGetParam(func, 0), ett_llvm_type((EagleComplexType *)ett), "");
-        ett->counted = 0;
+        LLVMValueRef me = LLVMBuildBitCast(cb->builder, LLVMGetParam(func, 0), ett_llvm_type(cett), "");
         char *destruct_name = ac_gen_method_name(a->name, (char *)"__destruct__");
         LLVMBuildCall(cb->builder, LLVMGetNamedFunction(cb->module, destruct_name), &me, 1, "");
         free(destruct_name);
@@ -429,14 +498,12 @@ void ac_make_class_destructor(AST *ast, CompilerBundle *cb)
     LLVMBuildCondBr(cb->builder, cmp, ifBB, elseBB);
     LLVMPositionBuilderAtEnd(cb->builder, ifBB);
 
-    ett->counted = 1;
-    LLVMValueRef cast = LLVMBuildBitCast(cb->builder, LLVMGetParam(func, 0), ett_llvm_type((EagleComplexType *)ett), "");
-    LLVMBuildStore(cb->builder, LLVMBuildStructGEP(cb->builder, cast, 5, ""), pos);
+    LLVMValueRef cast = LLVMBuildBitCast(cb->builder, LLVMGetParam(func, 0), ett_llvm_type(cett), "");
+    LLVMBuildStore(cb->builder, LLVMBuildStructGEP(cb->builder, cast, ET_COUNTED_PAYLOAD, ""), pos);
     LLVMBuildBr(cb->builder, mergeBB);
 
-    ett->counted = 0;
     LLVMPositionBuilderAtEnd(cb->builder, elseBB);
-    cast = LLVMBuildBitCast(cb->builder, LLVMGetParam(func, 0), ett_llvm_type((EagleComplexType *)ett), "");
+    cast = LLVMBuildBitCast(cb->builder, LLVMGetParam(func, 0), ett_llvm_type(ett), "");
     LLVMBuildStore(cb->builder, cast, pos);
     LLVMBuildBr(cb->builder, mergeBB);
 
@@ -43,6 +43,7 @@ int ac_compile_block(AST *ast, LLVMBasicBlockRef block, CompilerBundle *cb)
             }
         }
 
+        cb->currentStatement = ast;
         ac_dispatch_statement(ast, cb);
     }
 
@@ -127,8 +128,9 @@ void ac_compile_yield(AST *ast, LLVMBasicBlockRef block, CompilerBundle *cb)
 
     LLVMBuildStore(cb->builder, val, LLVMGetParam(cb->currentFunction, 1));
 
+    LLVMValueRef resume = LLVMConstInt(LLVMInt32TypeInContext(utl_get_current_context()), cb->yieldBlocks->count - 1, 0);
     LLVMValueRef blockPos = LLVMBuildStructGEP(cb->builder, ctx, 1, "");
-    LLVMBuildStore(cb->builder, LLVMBlockAddress(cb->currentFunction, nblock), blockPos);
+    LLVMBuildStore(cb->builder, LLVMConstIntToPtr(resume, LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0)), blockPos);
 
     LLVMBuildRet(cb->builder, LLVMConstInt(LLVMInt1TypeInContext(utl_get_current_context()), 1, 0));
 
@@ -287,6 +289,10 @@ LLVMValueRef ac_compile_ternary(AST *ast, CompilerBundle *cb)
 
     // Handle elvis operator (?:)
     LLVMValueRef valA = tree_ifYes ? ac_dispatch_expression(tree_ifYes, cb) : test_raw;
+
+    // Either branch may have grown new blocks (interface calls and short
+    // circuited logic branch), so keep track of where each one ends
+    LLVMBasicBlockRef yesEnd = LLVMGetInsertBlock(cb->builder);
     
     LLVMPositionBuilderAtEnd(cb->builder, ifnoBB);
     LLVMValueRef valB = ac_dispatch_expression(tree_ifNo, cb);
@@ -300,6 +306,8 @@ LLVMValueRef ac_compile_ternary(AST *ast, CompilerBundle *cb)
     if(!ett_are_same(ytype, ntype))
         valB = ac_build_conversion(cb, valB, ntype, ytype, LOOSE_CONVERSION, tree_ifNo->lineno);
 
+    LLVMBasicBlockRef noEnd = LLVMGetInsertBlock(cb->builder);
+
     // Now we need to build a temporary alloca to store the result
     LLVMPositionBuilderAtEnd(cb->builder, cb->currentFunctionEntry);
     LLVMValueRef begin = LLVMGetFirstInstruction(cb->currentFunctionEntry);
@@ -319,12 +327,15 @@ LLVMValueRef ac_compile_ternary(AST *ast, CompilerBundle *cb)
 
     if(need_loaded)
     {
-        LLVMPositionBuilderAtEnd(cb->builder, ifyesBB);
+        LLVMPositionBuilderAtEnd(cb->builder, yesEnd);
         if(!hst_remove_key(&cb->loadedTransients, yes_tree, ahhd, ahed))
             ac_incr_val_pointer(cb, &valA, ytype);
-        LLVMPositionBuilderAtEnd(cb->builder, ifnoBB);
+        yesEnd = LLVMGetInsertBlock(cb->builder);
+
+        LLVMPositionBuilderAtEnd(cb->builder, noEnd);
         if(!hst_remove_key(&cb->loadedTransients, tree_ifNo, ahhd, ahed))
             ac_incr_val_pointer(cb, &valB, ytype);
+        noEnd = LLVMGetInsertBlock(cb->builder);
     }
 
     hst_remove_key(&cb->transients, yes_tree, ahhd, ahed);
@@ -339,11 +350,11 @@ LLVMValueRef ac_compile_ternary(AST *ast, CompilerBundle *cb)
         hst_put(&cb->transients, ast, opened_output, ahhd, ahed);
 
     // Now we will go back and assign those temp values to the alloc'd variable
-    LLVMPositionBuilderAtEnd(cb->builder, ifyesBB);
+    LLVMPositionBuilderAtEnd(cb->builder, yesEnd);
     LLVMBuildStore(cb->builder, valA, output);
     LLVMBuildBr(cb->builder, mergeBB);
 
-    LLVMPositionBuilderAtEnd(cb->builder, ifnoBB);
+    LLVMPositionBuilderAtEnd(cb->builder, noEnd);
     LLVMBuildStore(cb->builder, valB, output);
     LLVMBuildBr(cb->builder, mergeBB);
 
@@ -370,8 +381,8 @@ void ac_compile_loop(AST *ast, CompilerBundle *cb)
 
     // Stuff for iteration
     int rangeBased = a->setup && a->test && !a->update;
-    LLVMValueRef gen, rawGen;
-    gen = rawGen = NULL;
+    LLVMValueRef gen, rawGen, frame, code;
+    gen = rawGen = frame = code = NULL;
     LLVMValueRef iterator = NULL;
     EagleComplexType *ypt = NULL;
 
@@ -382,7 +393,9 @@ void ac_compile_loop(AST *ast, CompilerBundle *cb)
         iterator = ac_dispatch_expression(a->setup, cb);
         if(rangeBased)
         {
-            gen = rawGen = ac_dispatch_expression(a->test, cb);
+            frame = ac_generator_stack_frame(a->test, cb, &code);
+            if(!frame)
+                gen = rawGen = ac_dispatch_expression(a->test, cb);
 
             if(!hst_remove_key(&cb->loadedTransients, a->test, ahhd, ahed))
                 rawGen = NULL;
@@ -403,8 +416,7 @@ void ac_compile_loop(AST *ast, CompilerBundle *cb)
             else
             {
                 EagleComplexType *gt = ett_gen_type(a->setup->resultantType);
-                EagleComplexType *pt = ett_pointer_type(gt);
-                ((EaglePointerType *)pt)->counted = 1;
+                EagleComplexType *pt = ett_pointer_type_ex(gt, 1, 0, 0);
                 rawGen = gen = ac_try_view_conversion(cb, gen, a->test->resultantType, pt);
                 ypt = ett_pointer_type(a->setup->resultantType);
             }
@@ -418,9 +430,20 @@ void ac_compile_loop(AST *ast, CompilerBundle *cb)
     AST *tmpr;
 
     LLVMValueRef val = NULL;
-    if(rangeBased)
+    if(frame)
+    {
+        LLVMValueRef args[2];
+        args[0] = LLVMBuildBitCast(cb->builder, frame, LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0), "");
+        args[1] = iterator;
+
+        val = LLVMBuildCall(cb->builder, code, args, 2, "iterout");
+
+        tmpr = ast_make();
+        tmpr->resultantType = ett_base_type(ETInt1);
+    }
+    else if(rangeBased)
     {
-        gen = LLVMBuildStructGEP(cb->builder, gen, 5, ""); // Unwrap since it's counted
+        gen = LLVMBuildStructGEP(cb->builder, gen, ET_COUNTED_PAYLOAD, ""); // Unwrap since it's counted
         LLVMValueRef clo = LLVMBuildStructGEP(cb->builder, gen, 0, "");
         LLVMValueRef func = LLVMBuildLoad(cb->builder, clo, "");
 
@@ -472,7 +495,9 @@ void ac_compile_loop(AST *ast, CompilerBundle *cb)
 
     LLVMPositionBuilderAtEnd(cb->builder, mergeBB);
     vs_run_callbacks_through(cb->varScope, cb->varScope->scope);
-    if(rangeBased && rawGen)
+    if(frame)
+        ac_generator_release_frame(cb, frame);
+    else if(rangeBased && rawGen)
         ac_decr_val_pointer(cb, &rawGen, a->test->resultantType);
     vs_pop(cb->varScope);
 
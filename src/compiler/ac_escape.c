@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "ast_compiler.h"
+
+// A conservative, purely syntactic escape analysis. A local escapes unless
+// every mention of it is one of the uses allowed by the caller; copying it,
+// passing it on, returning it, taking an address into it, capturing it in
+// a closure or shadowing its name all count as escapes. Objects owned by a
+// variable that does not escape cannot outlive it, so they may live on the
+// stack of the function that declares it.
+
+// How deep ESC_PASS follows arguments into the functions they are passed to
+#define ESC_MAX_DEPTH 4
+
+typedef struct {
+    char *ident;
+    int uses;
+    int escaped;
+    int depth;
+    CompilerBundle *cb;
+    EagleComplexType *obj; // What a counted object points to, if it is one
+} EscapeHelper;
+
+static int ac_escapes_ex(AST *ast, EscapeHelper *eh);
+
+static int ac_escapes_as(AST *ast, EscapeHelper *eh, int uses)
+{
+    EscapeHelper sub = *eh;
+    sub.uses = uses;
+    return ac_escapes_ex(ast, &sub);
+}
+
+static int ac_is_ident(AST *ast, char *ident)
+{
+    return ast && ast->type == AIDENT && !strcmp(((ASTValue *)ast)->value.id, ident);
+}
+
+// v itself, or *v as in v->member
+static int ac_is_object(AST *ast, char *ident)
+{
+    if(ast && ast->type == AUNARY && ((ASTUnary *)ast)->op == '*')
+        ast = ((ASTUnary *)ast)->val;
+    return ac_is_ident(ast, ident);
+}
+
+// Assignments, plain and compound
+static int ac_is_store(AST *ast)
+{
+    if(ast->type != ABINARY)
+        return 0;
+    return strchr("=PMTDRAOXIE", ((ASTBinary *)ast)->op) != NULL;
+}
+
+static void ac_escapes_each(void *key, void *val, void *data)
+{
+    EscapeHelper *eh = data;
+    if(!eh->escaped)
+        eh->escaped = ac_escapes_ex(val, eh);
+}
+
+// Whether passing the local as argument index of a call to callee lets it
+// escape. Only functions defined in this module are followed, into the
+// uses of the matching parameter
+static int ac_passed_escapes(AST *callee, int index, EscapeHelper *eh)
+{
+    if(!(eh->uses & ESC_PASS) || eh->depth >= ESC_MAX_DEPTH || callee->type != AIDENT)
+        return 1;
+
+    char *name = ((ASTValue *)callee)->value.id;
+    ASTFuncDecl *fd = hst_get(&eh->cb->functionDecls, name, NULL, NULL);
+    if(!fd)
+        return 1;
+
+    // Shadowed by a local. Inside the bodies followed from here, locals
+    // that could shadow a function are caught as declarations instead
+    if(!eh->depth)
+    {
+        VarBundle *vb = vs_get(eh->cb->varScope, name);
+        if(!vb || vb->value != LLVMGetNamedFunction(eh->cb->module, name))
+            return 1;
+    }
+
+    AST *p, *param = NULL;
+    int i;
+    for(p = fd->params, i = 0; p; p = p->next, i++)
+    {
+        if(i == index)
+            param = p;
+        if(hst_get(&eh->cb->functionDecls, ((ASTVarDecl *)p)->ident, NULL, NULL))
+            return 1;
+    }
+
+    if(!param)
+        return 1;
+
+    // Objects must arrive as what they are for their methods to be known
+    if(eh->obj)
+    {
+        EagleComplexType *pt = ((ASTTypeDecl *)((ASTVarDecl *)param)->atype)->etype;
+        if(pt->type != ETPointer || !ett_are_same(((EaglePointerType *)pt)->to, eh->obj))
+            return 1;
+    }
+
+    EscapeHelper sub = *eh;
+    sub.ident = ((ASTVarDecl *)param)->ident;
+    sub.depth++;
+    return ac_escapes_ex(fd->body, &sub);
+}
+
+typedef struct {
+    char *name;
+    ASTFuncDecl *found;
+} MethodHelper;
+
+static void ac_find_method_each(void *key, void *val, void *data)
+{
+    MethodHelper *mh = data;
+    ASTFuncDecl *fd = key;
+    if(!strcmp(fd->ident, mh->name))
+        mh->found = fd;
+}
+
+// Whether a method of the object's class lets self escape. Every method
+// takes self as its first parameter
+static int ac_method_escapes(AST *method, EscapeHelper *eh)
+{
+    if(!method || !(eh->uses & ESC_PASS) || eh->depth >= ESC_MAX_DEPTH)
+        return 1;
+
+    ASTFuncDecl *fd = (ASTFuncDecl *)method;
+    if(!fd->body)
+        return 1;
+
+    EscapeHelper sub = *eh;
+    sub.ident = (char *)"self";
+    sub.depth++;
+    return ac_escapes_ex(fd->body, &sub);
+}
+
+static ASTClassDecl *ac_object_class(EscapeHelper *eh)
+{
+    if(!eh->obj || eh->obj->type != ETClass)
+        return NULL;
+
+    ASTClassDecl *cd = hst_get(&eh->cb->classDecls, ((EagleStructType *)eh->obj)->name, NULL, NULL);
+    return cd && !cd->ext ? cd : NULL;
+}
+
+static int ac_method_call_escapes(char *name, EscapeHelper *eh)
+{
+    ASTClassDecl *cd = ac_object_class(eh);
+    if(!cd)
+        return 1;
+
+    MethodHelper mh = {name, NULL};
+    hst_for_each(&cd->method_types, ac_find_method_each, &mh);
+
+    return ac_method_escapes((AST *)mh.found, eh);
+}
+
+static int ac_node_escapes(AST *ast, EscapeHelper *eh)
+{
+    char *ident = eh->ident;
+    int uses = eh->uses;
+
+    switch(ast->type)
+    {
+        case AIDENT:
+            return ac_is_ident(ast, ident) && !(uses & ESC_READ);
+        case AVALUE:
+        case ATYPE:
+        case ATYPELOOKUP:
+        case AENUMITEM:
+        case ASKIP:
+            return 0;
+        case AVARDECL:
+            {
+                char *decl = ((ASTVarDecl *)ast)->ident;
+                if((uses & ESC_PASS) && hst_get(&eh->cb->functionDecls, decl, NULL, NULL))
+                    return 1;
+                return !strcmp(decl, ident);
+            }
+        case ABINARY:
+        case AALLOC:
+            {
+                ASTBinary *a = (ASTBinary *)ast;
+                if(ac_is_store(ast) && ac_is_ident(a->left, ident))
+                    return 1;
+                return ac_escapes_ex(a->left, eh) || ac_escapes_ex(a->right, eh);
+            }
+        case AUNARY:
+            {
+                ASTUnary *a = (ASTUnary *)ast;
+                // Any address taken inside the object outlives the analysis
+                if(a->op == '&')
+                    return ac_escapes_as(a->val, eh, 0);
+                if(a->op == '*' && ac_is_ident(a->val, ident))
+                    return !(uses & (ESC_DEREF | ESC_READ));
+                return ac_escapes_ex(a->val, eh);
+            }
+        case AFUNCCALL:
+            {
+                ASTFuncCall *a = (ASTFuncCall *)ast;
+                if(ac_is_ident(a->callee, ident))
+                {
+                    if(!(uses & (ESC_CALL | ESC_READ)))
+                        return 1;
+                }
+                // Method calls hand the object itself to the method
+                else if(a->callee->type == ASTRUCTMEMBER && ac_is_object(((ASTStructMemberGet *)a->callee)->left, ident))
+                {
+                    if(!(uses & ESC_READ) && ac_method_call_escapes(((ASTStructMemberGet *)a->callee)->ident, eh))
+                        return 1;
+                }
+                else if(ac_escapes_ex(a->callee, eh))
+                    return 1;
+
+                AST *p;
+                int i;
+                for(p = a->params, i = 0; p; p = p->next, i++)
+                {
+                    if(ac_is_ident(p, ident))
+                    {
+                        if(!(uses & ESC_READ) && ac_passed_escapes(a->callee, i, eh))
+                            return 1;
+                    }
+                    else if(ac_node_escapes(p, eh))
+                        return 1;
+                }
+
+                return 0;
+            }
+        case ASTRUCTMEMBER:
+            {
+                ASTStructMemberGet *a = (ASTStructMemberGet *)ast;
+                if(ac_is_object(a->left, ident))
+                    return !(uses & (ESC_MEMBER | ESC_READ));
+                return ac_escapes_ex(a->left, eh);
+            }
+        case ASTRUCTLIT:
+            {
+                EscapeHelper sub = *eh;
+                sub.escaped = 0;
+                hst_for_each(&((ASTStructLit *)ast)->exprs, ac_escapes_each, &sub);
+                return sub.escaped;
+            }
+        case ACAST:
+            return ac_escapes_ex(((ASTCast *)ast)->val, eh);
+        case AFUNCDECL:
+        case AGENDECL:
+            {
+                // Anything a closure mentions is captured by it
+                ASTFuncDecl *a = (ASTFuncDecl *)ast;
+                return ac_escapes_as(a->params, eh, 0) || ac_escapes_as(a->body, eh, 0);
+            }
+        case AIF:
+            {
+                ASTIfBlock *a = (ASTIfBlock *)ast;
+                return ac_escapes_ex(a->test, eh) || ac_escapes_ex(a->block, eh) ||
+                    ac_escapes_ex(a->ifNext, eh);
+            }
+        case ALOOP:
+            {
+                ASTLoopBlock *a = (ASTLoopBlock *)ast;
+                int rangeBased = a->setup && a->test && !a->update;
+                if(rangeBased && ac_is_ident(a->test, ident))
+                {
+                    if(!(uses & (ESC_ITERATE | ESC_READ)))
+                        return 1;
+                }
+                else if(ac_escapes_ex(a->test, eh))
+                    return 1;
+
+                return ac_escapes_ex(a->setup, eh) || ac_escapes_ex(a->update, eh) ||
+                    ac_escapes_ex(a->block, eh);
+            }
+        case ASWITCH:
+            {
+                ASTSwitchBlock *a = (ASTSwitchBlock *)ast;
+                return ac_escapes_ex(a->test, eh) || ac_escapes_ex(a->cases, eh);
+            }
+        case ACASE:
+            {
+                ASTCaseBlock *a = (ASTCaseBlock *)ast;
+                return ac_escapes_ex(a->targ, eh) || ac_escapes_ex(a->body, eh);
+            }
+        case ADEFER:
+            return ac_escapes_ex(((ASTDefer *)ast)->block, eh);
+        case ATERNARY:
+            {
+                ASTTernary *a = (ASTTernary *)ast;
+                return ac_escapes_ex(a->test, eh) || ac_escapes_ex(a->ifyes, eh) ||
+                    ac_escapes_ex(a->ifno, eh);
+            }
+        default:
+            return 1;
+    }
+}
+
+static int ac_escapes_ex(AST *ast, EscapeHelper *eh)
+{
+    for(; ast; ast = ast->next)
+        if(ac_node_escapes(ast, eh))
+            return 1;
+
+    return 0;
+}
+
+// Whether ident escapes anywhere in the list of nodes starting at ast
+int ac_escapes(AST *ast, char *ident, int uses, CompilerBundle *cb)
+{
+    EscapeHelper eh = {ident, uses, 0, 0, cb, NULL};
+    return ac_escapes_ex(ast, &eh);
+}
+
+// Whether a value passed as argument index of a call to callee escapes.
+// obj is what the value points to when it is a counted object
+int ac_argument_escapes(AST *callee, int index, int uses, EagleComplexType *obj, CompilerBundle *cb)
+{
+    // The stack of a generator is its heap context
+    if(cb->yieldBlocks)
+        return 1;
+
+    EscapeHelper eh = {NULL, uses | ESC_PASS, 0, 0, cb, obj};
+    return ac_passed_escapes(callee, index, &eh);
+}
+
+// Whether the variable declared by the store ast escapes the rest of its
+// block. Only declarations made as statements of their own have a known
+// scope; anything else is taken to escape
+int ac_declaration_escapes(AST *ast, CompilerBundle *cb, int uses, EagleComplexType *obj)
+{
+    ASTBinary *a = (ASTBinary *)ast;
+    if(ast != cb->currentStatement || a->left->type != AVARDECL || cb->yieldBlocks)
+        return 1;
+
+    ASTVarDecl *decl = (ASTVarDecl *)a->left;
+    if(decl->linkage == VLStatic)
+        return 1;
+
+    EscapeHelper eh = {decl->ident, uses, 0, 0, cb, obj};
+    return ac_escapes_ex(ast->next, &eh);
+}
+
+// Whether a member access on an object of type ty can hand out a pointer
+// into it. Arrays decay to one, and the methods of a class held by value
+// get its address as self. Accesses chain (v.inner.arr), so structs held
+// by value are searched as well
+static int ac_has_interior_pointers(EagleComplexType *ty)
+{
+    Arraylist *names, *types;
+    ty_struct_get_members(ty, &names, &types);
+
+    int i;
+    for(i = 0; i < types->count; i++)
+    {
+        EagleComplexType *mt = arr_get(types, i);
+        if(mt->type == ETArray || mt->type == ETClass)
+            return 1;
+        if(mt->type == ETStruct && ac_has_interior_pointers(mt))
+            return 1;
+    }
+
+    return 0;
+}
+
+// The uses that leave the object made by the allocation ast where it is,
+// or -1 if the object may not live on the stack at all. Members must not
+// hand out pointers into the object, and a class's initializer and
+// destructor see the object as well
+int ac_allocation_uses(AST *ast, CompilerBundle *cb)
+{
+    EagleComplexType *to = ((ASTTypeDecl *)((ASTBinary *)ast)->left)->etype;
+
+    int uses;
+    switch(to->type)
+    {
+        case ETStruct:
+        case ETClass:
+            if(ac_has_interior_pointers(to))
+                return -1;
+            uses = ESC_MEMBER | ESC_PASS;
+            break;
+        case ETArray:
+        case ETFunction:
+        case ETGenerator:
+        case ETInterface:
+        case ETAuto:
+            return -1;
+        default:
+            uses = ESC_DEREF | ESC_PASS;
+            break;
+    }
+
+    if(to->type == ETClass)
+    {
+        EscapeHelper eh = {NULL, uses, 0, 0, cb, to};
+        ASTClassDecl *cd = ac_object_class(&eh);
+        if(!cd)
+            return -1;
+
+        if(cd->initdecl && ac_method_escapes(cd->initdecl, &eh))
+            return -1;
+        if(cd->destructdecl && ac_method_escapes(cd->destructdecl, &eh))
+            return -1;
+    }
+
+    return uses;
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef AC_ESCAPE_H
+#define AC_ESCAPE_H
+
+// Uses of a local that do not let its value leave the variable
+#define ESC_CALL    1 // v(...)
+#define ESC_ITERATE 2 // for x in v
+#define ESC_MEMBER  4 // v.member, v.member = ...
+#define ESC_PASS    8 // f(v) and v.method(), where f and the method only make these uses of it
+#define ESC_DEREF  16 // *v, *v = ...
+#define ESC_READ   32 // Anything that neither rebinds v nor takes its address
+
+int ac_escapes(AST *ast, char *ident, int uses, CompilerBundle *cb);
+int ac_argument_escapes(AST *callee, int index, int uses, EagleComplexType *obj, CompilerBundle *cb);
+int ac_declaration_escapes(AST *ast, CompilerBundle *cb, int uses, EagleComplexType *obj);
+int ac_allocation_uses(AST *ast, CompilerBundle *cb);
+
+#endif
@@ -81,7 +81,7 @@ LLVMValueRef ac_compile_identifier(AST *ast, CompilerBundle *cb)
     if(ET_IS_CLOSED(b->type))
     {
         a->resultantType = ((EaglePointerType *)b->type)->to;
-        LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, LLVMBuildLoad(cb->builder, b->value, ""), 5, "");
+        LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, LLVMBuildLoad(cb->builder, b->value, ""), ET_COUNTED_PAYLOAD, "");
 
         if(a->resultantType->type == ETArray || a->resultantType->type == ETStruct || a->resultantType->type == ETClass || a->resultantType->type == ETInterface)
             return pos;
@@ -187,6 +187,81 @@ LLVMValueRef ac_compile_var_decl(AST *ast, CompilerBundle *cb)
     return pos;
 }
 
+// Finds the method at index within the interface's block of the object's
+// class. The interface id is masked into the class's itable; a slot that
+// holds a different id (the class's itable could not place this interface)
+// falls back to the name based search in the runtime.
+static LLVMValueRef ac_compile_interface_dispatch(CompilerBundle *cb, LLVMValueRef obj, char *interface, int index)
+{
+    LLVMContextRef ctx = utl_get_current_context();
+    LLVMTypeRef i8p = LLVMPointerType(LLVMInt8TypeInContext(ctx), 0);
+    LLVMValueRef id = LLVMConstInt(LLVMInt64TypeInContext(ctx), ty_interface_id(interface), 0);
+
+    LLVMValueRef clsp = LLVMBuildBitCast(cb->builder, obj, LLVMPointerType(LLVMPointerType(ty_class_indirect(), 0), 0), "");
+    LLVMValueRef cls = LLVMBuildLoad(cb->builder, clsp, "cls");
+    LLVMValueRef mask = LLVMBuildLoad(cb->builder, LLVMBuildStructGEP(cb->builder, cls, 4, ""), "mask");
+    LLVMValueRef itable = LLVMBuildLoad(cb->builder, LLVMBuildStructGEP(cb->builder, cls, 5, ""), "itable");
+
+    LLVMValueRef slot = LLVMBuildAnd(cb->builder, id, mask, "");
+    LLVMValueRef entry = LLVMBuildGEP(cb->builder, itable, &slot, 1, "");
+    LLVMValueRef eid = LLVMBuildLoad(cb->builder, LLVMBuildStructGEP(cb->builder, entry, 0, ""), "");
+    LLVMValueRef hit = LLVMBuildICmp(cb->builder, LLVMIntEQ, eid, id, "");
+
+    LLVMBasicBlockRef fastBB = LLVMAppendBasicBlockInContext(ctx, cb->currentFunction, "itable");
+    LLVMBasicBlockRef slowBB = LLVMAppendBasicBlockInContext(ctx, cb->currentFunction, "lookup");
+    LLVMBasicBlockRef mergeBB = LLVMAppendBasicBlockInContext(ctx, cb->currentFunction, "dispatch");
+    LLVMBuildCondBr(cb->builder, hit, fastBB, slowBB);
+
+    LLVMPositionBuilderAtEnd(cb->builder, fastBB);
+    LLVMValueRef fns = LLVMBuildLoad(cb->builder, LLVMBuildStructGEP(cb->builder, entry, 1, ""), "");
+    LLVMValueRef idx = LLVMConstInt(LLVMInt64TypeInContext(ctx), index, 0);
+    LLVMValueRef fast = LLVMBuildLoad(cb->builder, LLVMBuildGEP(cb->builder, fns, &idx, 1, ""), "");
+    LLVMBuildBr(cb->builder, mergeBB);
+
+    LLVMPositionBuilderAtEnd(cb->builder, slowBB);
+    LLVMValueRef params[] = {
+        LLVMBuildBitCast(cb->builder, obj, i8p, ""),
+        LLVMBuildGlobalStringPtr(cb->builder, interface, "ifc"),
+        LLVMConstInt(LLVMInt32TypeInContext(ctx), index, 0)
+    };
+    LLVMValueRef slow = LLVMBuildCall(cb->builder, LLVMGetNamedFunction(cb->module, "__egl_lookup_method"), params, 3, "");
+    LLVMBuildBr(cb->builder, mergeBB);
+
+    LLVMPositionBuilderAtEnd(cb->builder, mergeBB);
+    LLVMValueRef phi = LLVMBuildPhi(cb->builder, i8p, "method");
+    LLVMValueRef vals[] = {fast, slow};
+    LLVMBasicBlockRef blocks[] = {fastBB, slowBB};
+    LLVMAddIncoming(phi, vals, blocks, 2);
+
+    return phi;
+}
+
+// The method of the class known to be behind the interface pointer on the
+// left of a member access, or NULL when it has to be looked up at runtime.
+// Classes have no subclasses, so a local made from a class pointer and never
+// rebound always holds an object of exactly that class
+static LLVMValueRef ac_compile_direct_method(AST *left, char *ident, CompilerBundle *cb)
+{
+    if(left->type == AUNARY && ((ASTUnary *)left)->op == '*')
+        left = ((ASTUnary *)left)->val;
+    if(left->type != AIDENT)
+        return NULL;
+
+    VarBundle *vb = vs_get(cb->varScope, ((ASTValue *)left)->value.id);
+    if(!vb || !vb->concrete)
+        return NULL;
+
+    char *cls = ((EagleStructType *)vb->concrete)->name;
+    if(!ty_method_lookup(cls, ident))
+        return NULL;
+
+    char *name = ac_gen_method_name(cls, ident);
+    LLVMValueRef func = LLVMGetNamedFunction(cb->module, name);
+    free(name);
+
+    return func;
+}
+
 LLVMValueRef ac_compile_struct_member(AST *ast, CompilerBundle *cb, int keepPointer)
 {
     ASTStructMemberGet *a = (ASTStructMemberGet *)ast;
@@ -221,13 +296,9 @@ LLVMValueRef ac_compile_struct_member(AST *ast, CompilerBundle *cb, int keepPoin
         a->leftCompiled = lcw; // a->left->type == AUNARY ? ((ASTUnary *)a->left)->savedWrapped : left;
         a->leftCompiled = LLVMBuildBitCast(cb->builder, a->leftCompiled, LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0), "");
         EagleComplexType *ut = ty_method_lookup(interface, a->ident);
-        LLVMValueRef func = LLVMGetNamedFunction(cb->module, "__egl_lookup_method");
-
-        LLVMValueRef params[] = {left, //LLVMBuildStructGEP(cb->builder, left, 0, "vtable"),
-                                 LLVMBuildGlobalStringPtr(cb->builder, interface, "ifc"),
-                                 LLVMConstInt(LLVMInt32TypeInContext(utl_get_current_context()), ty_interface_offset(interface, a->ident), 0)
-        };
-        LLVMValueRef fptr = LLVMBuildCall(cb->builder, func, params, 3, a->ident);
+        LLVMValueRef fptr = ac_compile_direct_method(a->left, a->ident, cb);
+        if(!fptr)
+            fptr = ac_compile_interface_dispatch(cb, left, interface, ty_interface_offset(interface, a->ident));
         fptr = LLVMBuildBitCast(cb->builder, fptr, LLVMPointerType(ett_llvm_type(ut), 0), "");
 
         a->resultantType = ett_pointer_type(ut);
@@ -286,94 +357,82 @@ LLVMValueRef ac_compile_type_lookup(AST *ast, CompilerBundle *cb)
 
 LLVMValueRef ac_compile_malloc_counted_raw(LLVMTypeRef rt, LLVMTypeRef *out, CompilerBundle *cb)
 {
-    LLVMTypeRef ptmp[2];
-    ptmp[0] = LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0);
-    ptmp[1] = LLVMInt1TypeInContext(utl_get_current_context());
-
-    LLVMTypeRef tys[6];
-    tys[0] = LLVMInt64TypeInContext(utl_get_current_context());
-    tys[1] = LLVMInt16TypeInContext(utl_get_current_context());
-    tys[2] = LLVMInt16TypeInContext(utl_get_current_context());
-    tys[3] = LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0);
-    tys[4] = LLVMPointerType(LLVMFunctionType(LLVMVoidTypeInContext(utl_get_current_context()), ptmp, 2, 0), 0);
-    tys[5] = rt;
-    LLVMTypeRef tt = LLVMStructTypeInContext(utl_get_current_context(), tys, 6, 0);
+    LLVMTypeRef tys[4];
+    tys[0] = LLVMInt32TypeInContext(utl_get_current_context());
+    tys[1] = LLVMInt32TypeInContext(utl_get_current_context());
+    tys[2] = LLVMPointerType(ty_type_descriptor(), 0);
+    tys[3] = rt;
+    LLVMTypeRef tt = LLVMStructTypeInContext(utl_get_current_context(), tys, 4, 0);
     tt = ty_get_counted(tt);
 
-    LLVMValueRef mal = LLVMBuildMalloc(cb->builder, tt, "new");
+    LLVMValueRef mal = ac_alloc_counted(cb, tt, NULL);
 
     *out = tt;
 
-    ac_prepare_pointer(cb, mal, NULL);
-
     return mal;
 }
 
-LLVMValueRef ac_compile_malloc_counted(EagleComplexType *type, EagleComplexType **res, LLVMValueRef ib, CompilerBundle *cb)
+// Objects that do not escape are made on the stack (see ac_alloc_counted_stack)
+static LLVMValueRef ac_compile_counted(EagleComplexType *type, EagleComplexType **res, LLVMValueRef ib, int onStack, CompilerBundle *cb)
 {
-    LLVMTypeRef ptmp[2];
-    ptmp[0] = LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0);
-    ptmp[1] = LLVMInt1TypeInContext(utl_get_current_context());
-
-    LLVMTypeRef tys[6];
-    tys[0] = LLVMInt64TypeInContext(utl_get_current_context());
-    tys[1] = LLVMInt16TypeInContext(utl_get_current_context());
-    tys[2] = LLVMInt16TypeInContext(utl_get_current_context());
-    tys[3] = LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0);
-    tys[4] = LLVMPointerType(LLVMFunctionType(LLVMVoidTypeInContext(utl_get_current_context()), ptmp, 2, 0), 0);
-    tys[5] = ett_llvm_type(type);
-    LLVMTypeRef tt = LLVMStructTypeInContext(utl_get_current_context(), tys, 6, 0);
+    LLVMTypeRef tys[4];
+    tys[0] = LLVMInt32TypeInContext(utl_get_current_context());
+    tys[1] = LLVMInt32TypeInContext(utl_get_current_context());
+    tys[2] = LLVMPointerType(ty_type_descriptor(), 0);
+    tys[3] = ett_llvm_type(type);
+    LLVMTypeRef tt = LLVMStructTypeInContext(utl_get_current_context(), tys, 4, 0);
 
     //LLVMDumpType(ett_llvm_type(type));
     tt = ty_get_counted(tt);
 
     //LLVMDumpType(tt);
-    LLVMValueRef mal;
-    if(ib)
-        mal = EGLBuildMalloc(cb->builder, tt, ib, "new");
-    else
-        mal = LLVMBuildMalloc(cb->builder, tt, "new");
+    LLVMValueRef mal = onStack ? ac_alloc_counted_stack(cb, tt) : ac_alloc_counted(cb, tt, ib);
 
-    EaglePointerType *pt = (EaglePointerType *)ett_pointer_type(type);
-    pt->counted = 1;
-    EagleComplexType *resultantType = (EagleComplexType *)pt;
+    EagleComplexType *resultantType = ett_pointer_type_ex(type, 1, 0, 0);
     if(res)
         *res = resultantType;
 
-    ac_prepare_pointer(cb, mal, resultantType);
     if((type->type == ETStruct && ty_needs_destructor(type)) || type->type == ETClass)
     {
-        LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, mal, 5, "");
+        LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, mal, ET_COUNTED_PAYLOAD, "");
         ac_call_constructor(cb, pos, type);
-        pos = LLVMBuildStructGEP(cb->builder, mal, 4, "");
         EagleStructType *st = (EagleStructType *)type;
-        LLVMBuildStore(cb->builder, ac_gen_struct_destructor_func(st->name, cb), pos);
+        ac_set_teardown(cb, mal, ac_gen_struct_destructor_func(st->name, cb));
     }
 
     // We need to specially handle counted counted types
     if(ET_IS_COUNTED(type))
     {
-        LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, mal, 4, "");
-        LLVMBuildStore(cb->builder, LLVMGetNamedFunction(cb->module, "__egl_counted_destructor"), pos);
+        ac_set_teardown(cb, mal, LLVMGetNamedFunction(cb->module, "__egl_counted_destructor"));
 
-        pos = LLVMBuildStructGEP(cb->builder, mal, 5, "");
+        LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, mal, ET_COUNTED_PAYLOAD, "");
         LLVMBuildStore(cb->builder, LLVMConstPointerNull(ett_llvm_type(type)), pos);
     }
     /*
     LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, mal, 0, "ctp");
-    LLVMBuildStore(cb->builder, LLVMConstInt(LLVMInt64TypeInContext(utl_get_current_context()), 0, 0), pos);
+    LLVMBuildStore(cb->builder, LLVMConstInt(LLVMInt32TypeInContext(utl_get_current_context()), 0, 0), pos);
     */
 
 
     return mal;
 }
 
+LLVMValueRef ac_compile_malloc_counted(EagleComplexType *type, EagleComplexType **res, LLVMValueRef ib, CompilerBundle *cb)
+{
+    return ac_compile_counted(type, res, ib, 0, cb);
+}
+
 LLVMValueRef ac_compile_new_decl(AST *ast, CompilerBundle *cb)
+{
+    return ac_compile_new_decl_ex(ast, cb, 0);
+}
+
+LLVMValueRef ac_compile_new_decl_ex(AST *ast, CompilerBundle *cb, int onStack)
 {
     ASTBinary *a = (ASTBinary *)ast;
     ASTTypeDecl *type = (ASTTypeDecl *)a->left;
 
-    LLVMValueRef val = ac_compile_malloc_counted(type->etype, &ast->resultantType, NULL, cb);
+    LLVMValueRef val = ac_compile_counted(type->etype, &ast->resultantType, NULL, onStack, cb);
     hst_put(&cb->transients, ast, val, ahhd, ahed);
 
     EagleComplexType *to = ((EaglePointerType *)ast->resultantType)->to;
@@ -389,7 +448,7 @@ LLVMValueRef ac_compile_new_decl(AST *ast, CompilerBundle *cb)
             if(!asl->name)
                 asl->name = ((EagleStructType *)to)->name;
 
-            LLVMValueRef strct = LLVMBuildStructGEP(cb->builder, val, 5, "");
+            LLVMValueRef strct = LLVMBuildStructGEP(cb->builder, val, ET_COUNTED_PAYLOAD, "");
             ac_compile_struct_lit(a->right, cb, strct);
             return val;
         }
@@ -398,7 +457,7 @@ LLVMValueRef ac_compile_new_decl(AST *ast, CompilerBundle *cb)
         
         if(!ett_are_same(a->right->resultantType, type->etype))
             init = ac_build_conversion(cb, init, a->right->resultantType, type->etype, LOOSE_CONVERSION, a->right->lineno);
-        LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, val, 5, "");
+        LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, val, ET_COUNTED_PAYLOAD, "");
         LLVMBuildStore(cb->builder, init, pos);
     }
     else if(to->type == ETClass && ty_get_init(((EagleStructType *)to)->name))
@@ -559,9 +618,6 @@ LLVMValueRef ac_compile_logical_or(AST *ast, CompilerBundle *cb)
 
         LLVMBasicBlockRef nextBB = LLVMAppendBasicBlockInContext(utl_get_current_context(), cb->currentFunction, "next");
 
-        arr_append(&values, LLVMConstInt(LLVMInt1TypeInContext(utl_get_current_context()), 1, 0));
-        arr_append(&blocks, LLVMGetInsertBlock(cb->builder));
-
         hst_for_each(&cb->transients, ac_decr_transients, cb);
         hst_for_each(&cb->loadedTransients, ac_decr_loaded_transients, cb);
 
@@ -571,6 +627,9 @@ LLVMValueRef ac_compile_logical_or(AST *ast, CompilerBundle *cb)
         cb->transients = hst_create();
         cb->loadedTransients = hst_create();
 
+        arr_append(&values, LLVMConstInt(LLVMInt1TypeInContext(utl_get_current_context()), 1, 0));
+        arr_append(&blocks, LLVMGetInsertBlock(cb->builder));
+
         LLVMBuildCondBr(cb->builder, cmp, mergeBB, nextBB);
 
         LLVMPositionBuilderAtEnd(cb->builder, nextBB);
@@ -1020,7 +1079,7 @@ LLVMValueRef ac_compile_unary(AST *ast, CompilerBundle *cb)
                     die(ALN, "Only pointers in the counted regime may be unwrapped.");
 
                 a->resultantType = ett_pointer_type(((EaglePointerType *)a->val->resultantType)->to);
-                return LLVMBuildStructGEP(cb->builder, v, 5, "unwrap");
+                return LLVMBuildStructGEP(cb->builder, v, ET_COUNTED_PAYLOAD, "unwrap");
             }
         case 's':
             {
@@ -1053,7 +1112,7 @@ LLVMValueRef ac_compile_unary(AST *ast, CompilerBundle *cb)
 LLVMValueRef ac_compile_generator_call(AST *ast, LLVMValueRef gen, CompilerBundle *cb)
 {
     ASTFuncCall *a = (ASTFuncCall *)ast;
-    gen = LLVMBuildStructGEP(cb->builder, gen, 5, ""); // Unwrap since it's counted
+    gen = LLVMBuildStructGEP(cb->builder, gen, ET_COUNTED_PAYLOAD, ""); // Unwrap since it's counted
     LLVMValueRef clo = LLVMBuildStructGEP(cb->builder, gen, 0, "");
     LLVMValueRef func = LLVMBuildLoad(cb->builder, clo, "");
 
@@ -1147,12 +1206,28 @@ LLVMValueRef ac_compile_function_call(AST *ast, CompilerBundle *cb)
 
     LLVMValueRef args[ct + offset];
     EagleComplexType *param_types[ct + offset];
+    LLVMValueRef onStack[ct + 1];
+    int stackct = 0;
     for(p = a->params, i = start; p; p = p->next, i++)
     {
         if(i < ett->pct && ett->params[i]->type == ETEnum)
             cb->enum_lookup = ett->params[i];
 
-        LLVMValueRef val = ac_dispatch_expression(p, cb);
+        // Closures and objects written out as arguments to a function that
+        // never keeps them live on the stack for the duration of the call
+        LLVMValueRef val = NULL;
+        if(p->type == AFUNCDECL && !ac_argument_escapes(a->callee, i - start, ESC_CALL, NULL, cb))
+            val = onStack[stackct++] = ac_compile_closure_ex(p, cb, 1);
+        else if(p->type == AALLOC)
+        {
+            int uses = ac_allocation_uses(p, cb);
+            EagleComplexType *to = ((ASTTypeDecl *)((ASTBinary *)p)->left)->etype;
+            if(uses >= 0 && !ac_argument_escapes(a->callee, i - start, uses, to, cb))
+                val = onStack[stackct++] = ac_compile_new_decl_ex(p, cb, 1);
+        }
+
+        if(!val)
+            val = ac_dispatch_expression(p, cb);
         EagleComplexType *rt = p->resultantType;
 
         cb->enum_lookup = NULL;
@@ -1213,6 +1288,9 @@ LLVMValueRef ac_compile_function_call(AST *ast, CompilerBundle *cb)
         hst_put(&cb->loadedTransients, ast, out, ahhd, ahed);
     }
 
+    for(i = 0; i < stackct; i++)
+        ac_teardown_stack_object(cb, onStack[i]);
+
     return out;
 }
 
@@ -1224,6 +1302,43 @@ void ac_set_static_initializer(int lineno, LLVMValueRef glob, LLVMValueRef init)
     LLVMSetInitializer(glob, init);
 }
 
+// Generators, closures and new objects that never leave the variable they
+// are declared into live on the stack. Returns NULL (having compiled nothing) otherwise
+static LLVMValueRef ac_compile_stack_object(AST *ast, CompilerBundle *cb)
+{
+    ASTBinary *a = (ASTBinary *)ast;
+    char *ident = ((ASTVarDecl *)a->left)->ident;
+
+    if(a->right->type == AFUNCCALL && !ac_declaration_escapes(ast, cb, ESC_CALL | ESC_ITERATE, NULL))
+        return ac_generator_stack_object(a->right, cb);
+
+    if(a->right->type == AFUNCDECL && !ac_escapes(a->right, ident, 0, cb) &&
+       !ac_declaration_escapes(ast, cb, ESC_CALL | ESC_PASS, NULL))
+        return ac_compile_closure_ex(a->right, cb, 1);
+
+    if(a->right->type == AALLOC && !ac_escapes(a->right, ident, 0, cb))
+    {
+        int uses = ac_allocation_uses(a->right, cb);
+        EagleComplexType *to = ((ASTTypeDecl *)((ASTBinary *)a->right)->left)->etype;
+        if(uses >= 0 && !ac_declaration_escapes(ast, cb, uses, to))
+            return ac_compile_new_decl_ex(a->right, cb, 1);
+    }
+
+    return NULL;
+}
+
+// Whether storing from into to turns a class pointer into an interface one
+// that still points at the class. A view method on the class may hand back
+// some other object instead (see ac_try_view_conversion)
+static int ac_is_class_view(EagleComplexType *from, EagleComplexType *to)
+{
+    if(from->type != ETPointer || ((EaglePointerType *)from)->to->type != ETClass ||
+       to->type != ETPointer || ((EaglePointerType *)to)->to->type != ETInterface)
+        return 0;
+
+    return !ty_method_lookup(((EagleStructType *)((EaglePointerType *)from)->to)->name, ett_unique_type_name(to));
+}
+
 LLVMValueRef ac_build_store(AST *ast, CompilerBundle *cb, char update)
 {
     ASTBinary *a = (ASTBinary *)ast;
@@ -1243,7 +1358,7 @@ LLVMValueRef ac_build_store(AST *ast, CompilerBundle *cb, char update)
         {
             totype = ((EaglePointerType *)b->type)->to;
             pos = LLVMBuildLoad(cb->builder, b->value, "");
-            pos = LLVMBuildStructGEP(cb->builder, pos, 5, "");
+            pos = LLVMBuildStructGEP(cb->builder, pos, ET_COUNTED_PAYLOAD, "");
         }
         else
         {
@@ -1331,9 +1446,15 @@ LLVMValueRef ac_build_store(AST *ast, CompilerBundle *cb, char update)
         return pos;
     }
 
+    LLVMValueRef r = NULL;
+    if(a->left->type == AVARDECL && (totype->type == ETAuto || ET_IS_COUNTED(totype)))
+        r = ac_compile_stack_object(ast, cb);
+    int onStack = r != NULL;
+
     if(totype && totype->type == ETEnum)
         cb->enum_lookup = totype;
-    LLVMValueRef r = ac_dispatch_expression(a->right, cb);
+    if(!r)
+        r = ac_dispatch_expression(a->right, cb);
     cb->enum_lookup = NULL;
     EagleComplexType *fromtype = a->right->resultantType;
 
@@ -1376,6 +1497,14 @@ LLVMValueRef ac_build_store(AST *ast, CompilerBundle *cb, char update)
 
     ac_safe_store(a->right, cb, pos, r, totype, staticInitializer, 1);
 
+    // An interface that is never rebound keeps the class it was made from
+    if(a->left->type == AVARDECL && ac_is_class_view(fromtype, totype) &&
+       !ac_declaration_escapes(ast, cb, ESC_READ, NULL))
+        vs_get(cb->varScope, ((ASTVarDecl *)a->left)->ident)->concrete = ((EaglePointerType *)fromtype)->to;
+
+    if(onStack)
+        vs_add_callback(cb->varScope, ((ASTVarDecl *)a->left)->ident, ac_scope_leave_stack_callback, cb);
+
     return LLVMBuildLoad(cb->builder, pos, "loadtmp");
 }
 
@@ -18,6 +18,7 @@ LLVMValueRef ac_compile_type_lookup(AST *ast, CompilerBundle *cb);
 LLVMValueRef ac_compile_malloc_counted_raw(LLVMTypeRef rt, LLVMTypeRef *out, CompilerBundle *cb);
 LLVMValueRef ac_compile_malloc_counted(EagleComplexType *type, EagleComplexType **res, LLVMValueRef ib, CompilerBundle *cb);
 LLVMValueRef ac_compile_new_decl(AST *ast, CompilerBundle *cb);
+LLVMValueRef ac_compile_new_decl_ex(AST *ast, CompilerBundle *cb, int onStack);
 LLVMValueRef ac_compile_cast(AST *ast, CompilerBundle *cb);
 LLVMValueRef ac_compile_index(AST *ast, int keepPointer, CompilerBundle *cb);
 LLVMValueRef ac_compile_binary(AST *ast, CompilerBundle *cb);
@@ -8,6 +8,7 @@
 
 #include "ast_compiler.h"
 #include "core/utils.h"
+#include "core/intern.h"
 
 char *ac_closure_context_name(char *name)
 {
@@ -45,6 +46,42 @@ void ac_pre_prepare_closure(CompilerBundle *cb, char *name, ClosureBundle *bun)
 
     bun->outerContext = NULL;
     bun->context = NULL;
+    bun->onStack = 0;
+}
+
+// A closure that captures nothing is the same every time it is created, so
+// it is built once as an immortal constant
+static LLVMValueRef ac_static_closure(CompilerBundle *cb, ClosureBundle *bun, LLVMTypeRef cloType, LLVMTypeRef *storageType)
+{
+    LLVMContextRef ctx = utl_get_current_context();
+
+    LLVMTypeRef tys[4];
+    tys[0] = LLVMInt32TypeInContext(ctx);
+    tys[1] = LLVMInt32TypeInContext(ctx);
+    tys[2] = LLVMPointerType(ty_type_descriptor(), 0);
+    tys[3] = cloType;
+    LLVMTypeRef ultType = LLVMStructTypeInContext(ctx, tys, 4, 0);
+
+    LLVMValueRef clo[2];
+    clo[0] = bun->function;
+    clo[1] = LLVMConstPointerNull(LLVMPointerType(LLVMInt8TypeInContext(ctx), 0));
+
+    LLVMValueRef vals[4];
+    vals[0] = LLVMConstInt(tys[0], ET_COUNT_IMMORTAL, 1);
+    vals[1] = LLVMConstInt(tys[1], 0, 0);
+    vals[2] = LLVMConstPointerNull(tys[2]);
+    vals[3] = LLVMConstNamedStruct(cloType, clo, 2);
+
+    char *name = ac_closure_closure_name(bun->name);
+    LLVMValueRef glob = LLVMAddGlobal(cb->module, ultType, name);
+    free(name);
+
+    LLVMSetLinkage(glob, LLVMPrivateLinkage);
+    LLVMSetGlobalConstant(glob, 1);
+    LLVMSetInitializer(glob, LLVMConstStructInContext(ctx, vals, 4, 0));
+
+    *storageType = ultType;
+    return glob;
 }
 
 LLVMValueRef ac_finish_closure(CompilerBundle *cb, ClosureBundle *bun, LLVMTypeRef *storageType)
@@ -71,102 +108,95 @@ LLVMValueRef ac_finish_closure(CompilerBundle *cb, ClosureBundle *bun, LLVMTypeR
 
     LLVMPositionBuilderAtEnd(cb->builder, bun->cfib);
 
-    LLVMTypeRef ultType;
-    LLVMValueRef countedFunc = ac_compile_malloc_counted_raw(cloType, &ultType, cb);
+    if(!bun->contextTypes->count)
+        return ac_static_closure(cb, bun, cloType, storageType);
+
+    // The context follows the closure in the same allocation, which lives
+    // on the stack when the closure does not escape (see ac_build_store)
+    LLVMTypeRef tys[5];
+    tys[0] = LLVMInt32TypeInContext(utl_get_current_context());
+    tys[1] = LLVMInt32TypeInContext(utl_get_current_context());
+    tys[2] = LLVMPointerType(ty_type_descriptor(), 0);
+    tys[3] = cloType;
+    tys[4] = bun->contextType;
+    LLVMTypeRef ultType = LLVMStructTypeInContext(utl_get_current_context(), tys, 5, 0);
+
+    LLVMValueRef countedFunc;
+    if(bun->onStack)
+        countedFunc = ac_alloc_counted_stack(cb, ultType);
+    else
+        countedFunc = ac_alloc_counted(cb, ultType, NULL);
 
-    LLVMValueRef contextTypeStruct = NULL;
-    if(bun->contextTypes->count > 0)
-        contextTypeStruct = LLVMBuildMalloc(cb->builder, bun->contextType, "");
+    LLVMValueRef contextTypeStruct = LLVMBuildStructGEP(cb->builder, countedFunc, ET_COUNTED_PAYLOAD + 1, "");
 
-    LLVMValueRef theFunc = LLVMBuildStructGEP(cb->builder, countedFunc, 5, "");
+    LLVMValueRef theFunc = LLVMBuildStructGEP(cb->builder, countedFunc, ET_COUNTED_PAYLOAD, "");
     *storageType = ultType;
 
     LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, theFunc, 0, "");
     LLVMBuildStore(cb->builder, bun->function, pos);
 
-    if(bun->contextTypes->count)
-    {
-        bun->outerContext = LLVMBuildStructGEP(cb->builder, theFunc, 1, "blockContext");
+    bun->outerContext = LLVMBuildStructGEP(cb->builder, theFunc, 1, "blockContext");
+    LLVMBuildStore(cb->builder, LLVMBuildBitCast(cb->builder, contextTypeStruct, LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0), ""), bun->outerContext);
 
-        LLVMBuildStore(cb->builder, LLVMBuildBitCast(cb->builder, contextTypeStruct, LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0), ""), bun->outerContext);
-        // bun->outerContext = LLVMBuildBitCast(cb->builder, , bun->contextType, "");
-
-
-        // LLVMValueRef checkPos = LLVMBuildStructGEP(cb->builder, theFunc, 1, "");
-        // LLVMBuildStore(cb->builder, LLVMConstInt(LLVMInt1TypeInContext(utl_get_current_context()), 1, 0), checkPos);
-
-        int i;
-        for(i = 0; i < bun->outerContextVals->count; i++)
-        {
-            VarBundle *o = bun->outerContextVals->items[i];
-
-            LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, contextTypeStruct, i, "");
-            LLVMBuildStore(cb->builder, LLVMBuildLoad(cb->builder, o->value, ""), pos);
-            ac_incr_pointer(cb, &pos, o->type);
-        }
-
-        LLVMValueRef first = LLVMGetFirstInstruction(bun->entry);
-        LLVMPositionBuilderBefore(cb->builder, first);
-
-        LLVMValueRef tmp = LLVMGetParam(bun->function, 0);
-        bun->context = LLVMBuildBitCast(cb->builder, tmp, LLVMPointerType(bun->contextType, 0), "context");
-
-        for(i = 0; i < bun->contextVals->count; i++)
-        {
-            LLVMValueRef temp = bun->contextVals->items[i];
-            LLVMValueRef var = LLVMBuildStructGEP(cb->builder, bun->context, i, "");
+    int i;
+    for(i = 0; i < bun->outerContextVals->count; i++)
+    {
+        VarBundle *o = bun->outerContextVals->items[i];
 
-            LLVMReplaceAllUsesWith(temp, var);
-        }
-        for(i = 0; i < bun->contextVals->count; i++)
-        {
-            LLVMValueRef temp = bun->contextVals->items[i];
-            LLVMInstructionEraseFromParent(temp);
-        }
+        LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, contextTypeStruct, i, "");
+        LLVMBuildStore(cb->builder, LLVMBuildLoad(cb->builder, o->value, ""), pos);
+        ac_incr_pointer(cb, &pos, o->type);
+    }
 
-        LLVMTypeRef des_params[2];
-        des_params[0] = LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0);
-        des_params[1] = LLVMInt1TypeInContext(utl_get_current_context());
+    // The teardown is set wherever building the closure left off
+    bun->cfib = LLVMGetInsertBlock(cb->builder);
 
-        char *desname = ac_closure_destructor_name(bun->name);
-        LLVMTypeRef des_func = LLVMFunctionType(LLVMVoidTypeInContext(utl_get_current_context()), des_params, 2, 0);
-        LLVMValueRef func_des = LLVMAddFunction(cb->module, desname, des_func);
-        free(desname);
+    LLVMValueRef first = LLVMGetFirstInstruction(bun->entry);
+    LLVMPositionBuilderBefore(cb->builder, first);
 
-        LLVMSetLinkage(func_des, LLVMPrivateLinkage);
+    LLVMValueRef tmp = LLVMGetParam(bun->function, 0);
+    bun->context = LLVMBuildBitCast(cb->builder, tmp, LLVMPointerType(bun->contextType, 0), "context");
 
-        LLVMBasicBlockRef dentry = LLVMAppendBasicBlockInContext(utl_get_current_context(), func_des, "entry");
+    for(i = 0; i < bun->contextVals->count; i++)
+    {
+        LLVMValueRef temp = bun->contextVals->items[i];
+        LLVMValueRef var = LLVMBuildStructGEP(cb->builder, bun->context, i, "");
 
-        LLVMPositionBuilderAtEnd(cb->builder, dentry);
-        LLVMValueRef strct = LLVMBuildBitCast(cb->builder, LLVMGetParam(func_des, 0), LLVMPointerType(ultType, 0), "");
-        strct = LLVMBuildStructGEP(cb->builder, strct, 5, "");
+        LLVMReplaceAllUsesWith(temp, var);
+    }
+    for(i = 0; i < bun->contextVals->count; i++)
+    {
+        LLVMValueRef temp = bun->contextVals->items[i];
+        LLVMInstructionEraseFromParent(temp);
+    }
 
-        strct = LLVMBuildStructGEP(cb->builder, strct, 1, "");
-        strct = LLVMBuildLoad(cb->builder, strct, "");
+    LLVMTypeRef des_params[2];
+    des_params[0] = LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0);
+    des_params[1] = LLVMInt1TypeInContext(utl_get_current_context());
 
-        strct = LLVMBuildBitCast(cb->builder, strct, LLVMPointerType(bun->contextType, 0), "");
+    char *desname = ac_closure_destructor_name(bun->name);
+    LLVMTypeRef des_func = LLVMFunctionType(LLVMVoidTypeInContext(utl_get_current_context()), des_params, 2, 0);
+    LLVMValueRef func_des = LLVMAddFunction(cb->module, desname, des_func);
+    free(desname);
 
-        for(i = 0; i < bun->contextTypes->count; i++)
-        {
-            LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, strct, i, "");
-            ac_decr_pointer(cb, &pos, NULL);
-        }
+    LLVMSetLinkage(func_des, LLVMPrivateLinkage);
 
-        LLVMBuildFree(cb->builder, strct);
+    LLVMBasicBlockRef dentry = LLVMAppendBasicBlockInContext(utl_get_current_context(), func_des, "entry");
 
-        LLVMBuildRetVoid(cb->builder);
+    LLVMPositionBuilderAtEnd(cb->builder, dentry);
+    LLVMValueRef strct = LLVMBuildBitCast(cb->builder, LLVMGetParam(func_des, 0), LLVMPointerType(ultType, 0), "");
+    strct = LLVMBuildStructGEP(cb->builder, strct, ET_COUNTED_PAYLOAD + 1, "");
 
-        LLVMPositionBuilderAtEnd(cb->builder, bun->cfib);
-        LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, countedFunc, 4, "");
-        LLVMBuildStore(cb->builder, func_des, pos);
-    }
-    else
+    for(i = 0; i < bun->contextTypes->count; i++)
     {
-        LLVMValueRef ctxPos = LLVMBuildStructGEP(cb->builder, theFunc, 1, "");
-        LLVMBuildStore(cb->builder, LLVMConstPointerNull(LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0)), ctxPos);
+        LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, strct, i, "");
+        ac_decr_pointer(cb, &pos, NULL);
     }
 
+    LLVMBuildRetVoid(cb->builder);
+
     LLVMPositionBuilderAtEnd(cb->builder, bun->cfib);
+    ac_set_teardown(cb, countedFunc, func_des);
 
     return countedFunc;
 }
@@ -204,6 +234,11 @@ void ac_closure_callback(VarBundle *vb, char *ident, void *data)
 }
 
 LLVMValueRef ac_compile_closure(AST *ast, CompilerBundle *cb)
+{
+    return ac_compile_closure_ex(ast, cb, 0);
+}
+
+LLVMValueRef ac_compile_closure_ex(AST *ast, CompilerBundle *cb, int onStack)
 {
     ASTFuncDecl *a = (ASTFuncDecl *)ast;
 
@@ -214,6 +249,7 @@ LLVMValueRef ac_compile_closure(AST *ast, CompilerBundle *cb)
 
     ClosureBundle cloclo;
     ac_pre_prepare_closure(cb, a->ident, &cloclo);
+    cloclo.onStack = onStack;
 
     Arraylist list = arr_create(8);
     Arraylist l2 = arr_create(8);
@@ -242,8 +278,6 @@ LLVMValueRef ac_compile_closure(AST *ast, CompilerBundle *cb)
 
     ASTTypeDecl *retType = (ASTTypeDecl *)a->retType;
 
-    EagleComplexType *ultimateEType = ett_function_type(retType->etype, eparam_types + 1, ct - 1);
-
     LLVMTypeRef funcType = LLVMFunctionType(ett_llvm_type(retType->etype), param_types, ct, 0);
 
     LLVMValueRef func = LLVMAddFunction(cb->module, ccode, funcType);
@@ -282,8 +316,7 @@ LLVMValueRef ac_compile_closure(AST *ast, CompilerBundle *cb)
         }
     }
 
-    ((EagleFunctionType *)ultimateEType)->closure = CLOSURE_RECURSE;
-    EagleComplexType *penultEType = ultimateEType;
+    EagleComplexType *penultEType = ett_function_type_ex(retType->etype, eparam_types + 1, ct - 1, CLOSURE_RECURSE, 0, 0);
     LLVMValueRef pos = LLVMBuildAlloca(cb->builder, ett_llvm_type(penultEType), "recur");
 
     LLVMValueRef posa = LLVMBuildStructGEP(cb->builder, pos, 0, "");
@@ -294,7 +327,7 @@ LLVMValueRef ac_compile_closure(AST *ast, CompilerBundle *cb)
     conv = LLVMBuildBitCast(cb->builder, LLVMGetParam(func, 0), LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0), "");
     LLVMBuildStore(cb->builder, conv, posb);
 
-    vs_put(cb->varScope, (char *)"recur", pos, penultEType, -1);
+    vs_put(cb->varScope, in_intern("recur"), pos, penultEType, -1);
 
     if(!ac_compile_block(a->body, entry, cb) && retType->etype->type != ETVoid)
         die(ALN, "Function must return a value.");
@@ -308,11 +341,15 @@ LLVMValueRef ac_compile_closure(AST *ast, CompilerBundle *cb)
     vs_pop(cb->varScope);
     vs_pop(cb->varScope);
 
+    // The closure object itself belongs to the enclosing function
+    cb->currentFunction = l_cf;
+    cb->currentFunctionEntry = l_entry;
+
     LLVMTypeRef ultType = NULL;
     LLVMValueRef built = ac_finish_closure(cb, &cloclo, &ultType);
-    cb->currentFunctionEntry = NULL;
 
-    ((EagleFunctionType *)ultimateEType)->closure = list.count == 0 ? CLOSURE_NO_CLOSE : CLOSURE_CLOSE;
+    EagleComplexType *ultimateEType = ett_function_type_ex(retType->etype, eparam_types + 1, ct - 1,
+                                                           list.count == 0 ? CLOSURE_NO_CLOSE : CLOSURE_CLOSE, 0, 0);
 
     arr_free(&list);
     arr_free(&l2);
@@ -326,8 +363,7 @@ LLVMValueRef ac_compile_closure(AST *ast, CompilerBundle *cb)
 
     LLVMPositionBuilderAtEnd(cb->builder, cloclo.cfib);
 
-    ultimateEType = ett_pointer_type(ultimateEType);
-    ((EaglePointerType *)ultimateEType)->counted = 1;
+    ultimateEType = ett_pointer_type_ex(ultimateEType, 1, 0, 0);
 
     /*
     LLVMValueRef out = LLVMBuildAlloca(cb->builder, LLVMPointerType(ultType, 0), "");
@@ -391,7 +427,7 @@ void ac_compile_function_ex(AST *ast, CompilerBundle *cb, LLVMValueRef func, Eag
             // is treated as used
             if(i == 0 && cb->compilingMethod)
             {
-                vs_get(cb->varScope, (char *)"self")->lineno = -1;
+                vs_get(cb->varScope, in_intern("self"))->lineno = -1;
                 continue;
             }
 
@@ -26,6 +26,8 @@ typedef struct {
     LLVMTypeRef funcType;
 
     LLVMValueRef outerContext;
+
+    int onStack;
 } ClosureBundle;
 
 char *ac_closure_context_name(char *name);
@@ -36,6 +38,7 @@ void ac_pre_prepare_closure(CompilerBundle *cb, char *name, ClosureBundle *bun);
 LLVMValueRef ac_finish_closure(CompilerBundle *cb, ClosureBundle *bun, LLVMTypeRef *storageType);
 void ac_closure_callback(VarBundle *vb, char *ident, void *data);
 LLVMValueRef ac_compile_closure(AST *ast, CompilerBundle *cb);
+LLVMValueRef ac_compile_closure_ex(AST *ast, CompilerBundle *cb, int onStack);
 void ac_compile_function(AST *ast, CompilerBundle *cb);
 void ac_compile_function_ex(AST *ast, CompilerBundle *cb, LLVMValueRef func, EagleFunctionType *ft);
 
@@ -12,9 +12,11 @@
 #include "ast_compiler.h"
 #include "core/utils.h"
 #include "core/colors.h"
+#include "core/trace.h"
+#include "core/intern.h"
 
 extern Hashtable global_args;
-extern char *current_file_name;
+extern EGL_THREAD_LOCAL char *current_file_name;
 
 static void ac_deferment_callback(AST *ast, void *data);
 
@@ -132,7 +134,12 @@ LLVMModuleRef ac_compile(AST *ast, int include_rc)
     cb.loadedTransients = hst_create();
     cb.genericFunctions = hst_create();
     cb.genericWorkList = arr_create(5);
+    cb.generatorFrames = hst_create();
+    cb.functionDecls = hst_create();
+    cb.classDecls = hst_create();
     cb.nextCaseBlock = NULL;
+    cb.yieldBlocks = NULL;
+    cb.currentStatement = NULL;
 
     cb.compilingMethod = 0;
     cb.inDeferment = 0;
@@ -163,12 +170,23 @@ LLVMModuleRef ac_compile(AST *ast, int include_rc)
     {
         ac_add_early_name_declaration(ast, &cb);
         ac_add_global_variable_declarations(ast, &cb);
+
+        // Followed by the escape analysis (see ac_escape.c)
+        if(ast->type == AFUNCDECL && ((ASTFuncDecl *)ast)->body)
+            hst_put(&cb.functionDecls, ((ASTFuncDecl *)ast)->ident, ast, NULL, NULL);
+        else if(ast->type == ACLASSDECL)
+            hst_put(&cb.classDecls, ((ASTClassDecl *)ast)->name, ast, NULL, NULL);
     }
     ast = old;
     for(; ast; ast = ast->next)
         ac_add_early_declarations(ast, &cb);
 
-    vs_put(cb.varScope, (char *)"__egl_millis", LLVMGetNamedFunction(cb.module, "__egl_millis"), ett_function_type(ett_base_type(ETInt64), NULL, 0), -1);
+    vs_put(cb.varScope, in_intern("__egl_millis"), LLVMGetNamedFunction(cb.module, "__egl_millis"), ett_function_type(ett_base_type(ETInt64), NULL, 0), -1);
+
+    // Modules built without the reference counting declarations are (or
+    // stand in for) the runtime itself
+    if(!include_rc)
+        ac_add_rc_primitives(&cb);
 
     ast = old;
 
@@ -177,12 +195,18 @@ LLVMModuleRef ac_compile(AST *ast, int include_rc)
     ac_generate_interface_definitions(ast, &cb);
     ac_make_class_definitions(ast, &cb);
 
+    // Generators go first so that loops over them can use their frames
     for(; ast; ast = ast->next)
-    {
-        ac_dispatch_declaration(ast, &cb);
-    }
+        if(ast->type == AGENDECL)
+            ac_dispatch_declaration(ast, &cb);
+
+    for(ast = old; ast; ast = ast->next)
+        if(ast->type != AGENDECL)
+            ac_dispatch_declaration(ast, &cb);
 
+    TraceSpan generics = trc_begin("generics");
     ac_compile_generics(&cb);
+    trc_end(&generics);
 
     vs_pop(cb.varScope);
 
@@ -196,6 +220,11 @@ LLVMModuleRef ac_compile(AST *ast, int include_rc)
     hst_free(&cb.loadedTransients);
     hst_free(&cb.genericFunctions);
 
+    hst_for_each(&cb.generatorFrames, ac_generator_free_frame, NULL);
+    hst_free(&cb.generatorFrames);
+    hst_free(&cb.functionDecls);
+    hst_free(&cb.classDecls);
+
     arr_free(&cb.genericWorkList);
 
     ec_free(cb.exports);
@@ -205,15 +234,12 @@ LLVMModuleRef ac_compile(AST *ast, int include_rc)
 
 void ac_prepare_module(LLVMModuleRef module)
 {
-    LLVMTypeRef param_types_rc[] = {LLVMPointerType(LLVMInt64TypeInContext(utl_get_current_context()), 0)};
+    LLVMTypeRef param_types_rc[] = {LLVMPointerType(LLVMInt32TypeInContext(utl_get_current_context()), 0)};
     LLVMTypeRef func_type_rc = LLVMFunctionType(LLVMVoidTypeInContext(utl_get_current_context()), param_types_rc, 1, 0);
-    LLVMAddFunction(module, "__egl_incr_ptr", func_type_rc);
-    LLVMAddFunction(module, "__egl_decr_ptr", func_type_rc);
-    LLVMAddFunction(module, "__egl_decr_no_free", func_type_rc);
-    LLVMAddFunction(module, "__egl_check_ptr", func_type_rc);
-    LLVMAddFunction(module, "__egl_prepare", func_type_rc);
+    LLVMAddFunction(module, "__egl_release_ptr", func_type_rc);
+    ac_add_rc_helpers(module);
 
-    LLVMTypeRef param_types_we[] = { LLVMPointerType(LLVMInt64TypeInContext(utl_get_current_context()), 0), LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0)};
+    LLVMTypeRef param_types_we[] = { LLVMPointerType(LLVMInt32TypeInContext(utl_get_current_context()), 0), LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0)};
     func_type_rc = LLVMFunctionType(LLVMVoidTypeInContext(utl_get_current_context()), param_types_we, 2, 0);
     LLVMAddFunction(module, "__egl_add_weak", func_type_rc);
 
@@ -329,8 +355,7 @@ void ac_add_early_declarations(AST *ast, CompilerBundle *cb)
     if(strcmp(a->ident, "printf") == 0)
     {
         LLVMValueRef func = LLVMGetNamedFunction(cb->module, "printf");
-        EagleComplexType *ftype = ett_function_type(retType->etype, eparam_types, ct);
-        ((EagleFunctionType *)ftype)->variadic = 1;
+        EagleComplexType *ftype = ett_function_type_ex(retType->etype, eparam_types, ct, NO_CLOSURE, 1, 0);
         vs_put(cb->varScope, a->ident, func, ftype, -1);
         return;
     }
@@ -344,14 +369,13 @@ void ac_add_early_declarations(AST *ast, CompilerBundle *cb)
         }
     }
 
-    EagleComplexType *ftype = ett_function_type(retType->etype, eparam_types, ct);
-    ((EagleFunctionType *)ftype)->variadic = a->vararg;
+    EagleComplexType *ftype = ett_function_type_ex(retType->etype, eparam_types, ct, NO_CLOSURE, a->vararg, 0);
 
     LLVMValueRef func = NULL;
 
     if(ac_decl_is_generic(ast))
     {
-        ac_generic_register(ast, ftype, cb);
+        ftype = ac_generic_register(ast, ftype, cb);
     }
     else
     {
@@ -41,13 +41,32 @@ char *ac_generator_destruct_name(char *gen)
     return name;
 }
 
-LLVMValueRef ac_compile_generator_destructor(CompilerBundle *cb, GeneratorBundle *gb)
+// Releases the references held by the locals of a generator frame
+static void ac_generator_release_fields(CompilerBundle *cb, LLVMValueRef ctx)
+{
+    LLVMTypeRef type = LLVMGetElementType(LLVMTypeOf(ctx));
+    unsigned ct = LLVMCountStructElementTypes(type);
+    LLVMTypeRef tys[ct];
+    LLVMGetStructElementTypes(type, tys);
+
+    unsigned i;
+    for(i = 2; i < ct; i++)
+    {
+        if(LLVMGetTypeKind(tys[i]) == LLVMPointerTypeKind)
+        {
+            LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, ctx, i, "");
+            ac_decr_pointer(cb, &pos, NULL);
+        }
+    }
+}
+
+LLVMValueRef ac_compile_generator_destructor(CompilerBundle *cb, GeneratorFrame *gf, LLVMTypeRef countedType)
 {
     LLVMTypeRef des_params[2];
     des_params[0] = LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0);
     des_params[1] = LLVMInt1TypeInContext(utl_get_current_context());
 
-    char *desname = ac_generator_destruct_name(gb->ident);
+    char *desname = ac_generator_destruct_name(gf->ident);
     LLVMTypeRef des_func = LLVMFunctionType(LLVMVoidTypeInContext(utl_get_current_context()), des_params, 2, 0);
     LLVMValueRef func_des = LLVMAddFunction(cb->module, desname, des_func);
     free(desname);
@@ -55,29 +74,60 @@ LLVMValueRef ac_compile_generator_destructor(CompilerBundle *cb, GeneratorBundle
     LLVMBasicBlockRef dentry = LLVMAppendBasicBlockInContext(utl_get_current_context(), func_des, "entry");
 
     LLVMPositionBuilderAtEnd(cb->builder, dentry);
-    LLVMValueRef strct = LLVMBuildBitCast(cb->builder, LLVMGetParam(func_des, 0), LLVMPointerType(gb->countedContextType, 0), "");
-    strct = LLVMBuildStructGEP(cb->builder, strct, 5, "");
+    LLVMValueRef strct = LLVMBuildBitCast(cb->builder, LLVMGetParam(func_des, 0), LLVMPointerType(countedType, 0), "");
+    strct = LLVMBuildStructGEP(cb->builder, strct, ET_COUNTED_PAYLOAD, "");
+
+    ac_generator_release_fields(cb, strct);
+
+    LLVMBuildRetVoid(cb->builder);
+
+    return func_des;
+}
+
+// Fills in a fresh frame, wherever it lives, from the generator's arguments
+static void ac_generator_setup_frame(CompilerBundle *cb, GeneratorFrame *gf, LLVMValueRef ctx, LLVMValueRef *args)
+{
+    LLVMTypeRef i8p = LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0);
+
+    LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, ctx, 0, "");
+    LLVMBuildStore(cb->builder, LLVMBuildBitCast(cb->builder, gf->code, i8p, ""), pos);
 
-    unsigned ct = LLVMCountStructElementTypes(gb->contextType);
+    // Resume point 0 is the start of the body (see ac_generator_replace_allocas)
+    pos = LLVMBuildStructGEP(cb->builder, ctx, 1, "");
+    LLVMBuildStore(cb->builder, LLVMConstPointerNull(i8p), pos);
+
+    // Null out the references in the context in case the generator is never used
+    unsigned ct = LLVMCountStructElementTypes(gf->contextType);
     LLVMTypeRef tys[ct];
-    LLVMGetStructElementTypes(gb->contextType, tys);
+    LLVMGetStructElementTypes(gf->contextType, tys);
 
     unsigned i;
     for(i = 2; i < ct; i++)
     {
         if(LLVMGetTypeKind(tys[i]) == LLVMPointerTypeKind)
         {
-            LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, strct, i, "");
-            ac_decr_pointer(cb, &pos, NULL);
+            LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, ctx, i, "");
+            LLVMBuildStore(cb->builder, LLVMConstPointerNull(tys[i]), pos);
         }
     }
 
-    LLVMBuildRetVoid(cb->builder);
+    EagleFunctionType *ett = gf->type;
+    int p;
+    for(p = 0; p < ett->pct; p++)
+    {
+        EagleComplexType *ty = ett->params[p];
+        LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, ctx, gf->param_fields[p], "");
 
-    return func_des;
+        LLVMBuildStore(cb->builder, args[p], pos);
+
+        if(ET_IS_COUNTED(ty))
+            ac_incr_pointer(cb, &pos, ty);
+        if(ET_IS_WEAK(ty))
+            ac_add_weak_pointer(cb, args[p], pos, ty);
+    }
 }
 
-LLVMValueRef ac_compile_generator_init(AST *ast, CompilerBundle *cb, GeneratorBundle *gb)
+LLVMValueRef ac_compile_generator_init(AST *ast, CompilerBundle *cb, GeneratorFrame *gf)
 {
     ASTFuncDecl *a = (ASTFuncDecl *)ast;
     VarBundle *vb = vs_get(cb->varScope, a->ident);
@@ -86,70 +136,161 @@ LLVMValueRef ac_compile_generator_init(AST *ast, CompilerBundle *cb, GeneratorBu
     LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(utl_get_current_context(), func, "entry");
     LLVMPositionBuilderAtEnd(cb->builder, entry);
 
-    EagleComplexType **eparam_types = gb->eparam_types;
-
     cb->currentFunctionEntry = entry;
     cb->currentFunction = func;
     cb->currentFunctionScope = cb->varScope->scope;
 
-    LLVMValueRef mmc = ac_compile_malloc_counted_raw(gb->contextType, &gb->countedContextType, cb);
-    LLVMValueRef ctx = LLVMBuildStructGEP(cb->builder, mmc, 5, "");
+    LLVMValueRef mmc = ac_compile_malloc_counted_raw(gf->contextType, &gf->countedType, cb);
+    LLVMValueRef ctx = LLVMBuildStructGEP(cb->builder, mmc, ET_COUNTED_PAYLOAD, "");
 
-    LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, ctx, 0, "");
-    LLVMBuildStore(cb->builder, LLVMBuildBitCast(cb->builder, gb->func, LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0), ""), pos);
+    ac_incr_val_pointer(cb, &mmc, gf->type->retType);
 
-    pos = LLVMBuildStructGEP(cb->builder, ctx, 1, "");
-    LLVMBuildStore(cb->builder, LLVMBlockAddress(gb->func, cb->yieldBlocks->items[0]), pos);
+    gf->destructor = ac_compile_generator_destructor(cb, gf, gf->countedType);
+    LLVMPositionBuilderAtEnd(cb->builder, entry);
+    ac_set_teardown(cb, mmc, gf->destructor);
 
-    ac_incr_val_pointer(cb, &mmc, ((EagleFunctionType *)vb->type)->retType);
+    LLVMValueRef args[gf->type->pct + 1];
+    int i;
+    for(i = 0; i < gf->type->pct; i++)
+        args[i] = LLVMGetParam(func, i);
 
-    pos = LLVMBuildStructGEP(cb->builder, mmc, 4, "");
+    ac_generator_setup_frame(cb, gf, ctx, args);
 
-    LLVMValueRef des_func = ac_compile_generator_destructor(cb, gb);
-    LLVMPositionBuilderAtEnd(cb->builder, entry);
-    LLVMBuildStore(cb->builder, des_func, pos);
+    LLVMValueRef ret = LLVMBuildBitCast(cb->builder, mmc, ett_llvm_type(gf->type->retType), "");
+    LLVMBuildRet(cb->builder, ret);
 
+    return NULL;
+}
 
-    // Null out the references in the context in case the generator is never used
-    unsigned ct = LLVMCountStructElementTypes(gb->contextType);
-    LLVMTypeRef tys[ct];
-    LLVMGetStructElementTypes(gb->contextType, tys);
+static int ac_generator_arg_count(AST *ast)
+{
+    if(ast->type != AFUNCCALL)
+        return 0;
 
-    unsigned i;
-    for(i = 2; i < ct; i++)
-    {
-        if(LLVMGetTypeKind(tys[i]) == LLVMPointerTypeKind)
-        {
-            LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, ctx, i, "");
-            LLVMBuildStore(cb->builder, LLVMConstPointerNull(tys[i]), pos);
-        }
-    }
-    // ==========================================================================
+    int i;
+    AST *p;
+    for(p = ((ASTFuncCall *)ast)->params, i = 0; p; p = p->next, i++);
 
-    if(a->params)
+    return i;
+}
+
+// Compiles the arguments of a call to a generator compiled earlier in this
+// module into args. Returns the generator, or NULL (having compiled nothing)
+// when the call has to go through the counted heap context
+static GeneratorFrame *ac_generator_direct_call(AST *ast, CompilerBundle *cb, LLVMValueRef *args)
+{
+    // Allocas in a generator body become fields of its own context, whose
+    // destructor would not release a nested frame
+    if(cb->yieldBlocks || ast->type != AFUNCCALL)
+        return NULL;
+
+    ASTFuncCall *a = (ASTFuncCall *)ast;
+    if(a->callee->type != AIDENT)
+        return NULL;
+
+    ASTValue *callee = (ASTValue *)a->callee;
+    GeneratorFrame *gf = hst_get(&cb->generatorFrames, callee->value.id, NULL, NULL);
+    if(!gf)
+        return NULL;
+
+    // Shadowed by a variable
+    VarBundle *vb = vs_get(cb->varScope, callee->value.id);
+    if(!vb || vb->value != gf->init)
+        return NULL;
+
+    EagleFunctionType *ett = gf->type;
+    if(ett->variadic)
+        return NULL;
+
+    // A weak reference would be left pointing into a dead frame
+    int i;
+    for(i = 0; i < ett->pct; i++)
+        if(ET_IS_WEAK(ett->params[i]))
+            return NULL;
+
+    AST *p;
+    for(p = a->params, i = 0; p; p = p->next, i++);
+    if(i != ett->pct)
+        die(ALN, "Function takes %d parameters, but %d provided", ett->pct, i);
+
+    for(p = a->params, i = 0; p; p = p->next, i++)
     {
-        int i;
-        AST *p = a->params;
-        for(i = 0; p; p = p->next, i++)
-        {
-            EagleComplexType *ty = eparam_types[i];
-            // LLVMValueRef pos = ac_compile_var_decl(p, cb);
-            LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, ctx, (int)(uintptr_t)hst_get(gb->params, (void *)(uintptr_t)(i + 1), ahhd, ahed), "");
+        if(ett->params[i]->type == ETEnum)
+            cb->enum_lookup = ett->params[i];
 
-            LLVMBuildStore(cb->builder, LLVMGetParam(func, i), pos);
+        LLVMValueRef val = ac_dispatch_expression(p, cb);
+        cb->enum_lookup = NULL;
 
-            if(ET_IS_COUNTED(ty))
-                ac_incr_pointer(cb, &pos, eparam_types[i]);
-            if(ET_IS_WEAK(ty))
-                ac_add_weak_pointer(cb, LLVMGetParam(func, i), pos, eparam_types[i]);
-        }
+        if(!ett_are_same(p->resultantType, ett->params[i]))
+            val = ac_build_conversion(cb, val, p->resultantType, ett->params[i], LOOSE_CONVERSION, p->lineno);
+
+        hst_remove_key(&cb->transients, p, ahhd, ahed);
+        args[i] = val;
     }
 
-    // LLVMDumpType(ett_llvm_type(vb->type));
-    LLVMValueRef ret = LLVMBuildBitCast(cb->builder, mmc, ett_llvm_type(((EagleFunctionType *)vb->type)->retType), "");
-    LLVMBuildRet(cb->builder, ret);
+    a->callee->resultantType = (EagleComplexType *)ett;
+    ast->resultantType = ett->retType;
 
-    return NULL;
+    return gf;
+}
+
+// A for-in loop over a direct call to a generator owns the generator
+// outright, so the frame goes on the stack of the loop's function and the
+// loop resumes the code function with direct calls, which the optimizer can
+// inline. Returns the frame, or NULL when there is no such call
+LLVMValueRef ac_generator_stack_frame(AST *ast, CompilerBundle *cb, LLVMValueRef *code)
+{
+    LLVMValueRef args[ac_generator_arg_count(ast) + 1];
+    GeneratorFrame *gf = ac_generator_direct_call(ast, cb, args);
+    if(!gf)
+        return NULL;
+
+    LLVMBasicBlockRef curblock = LLVMGetInsertBlock(cb->builder);
+    LLVMValueRef begin = LLVMGetFirstInstruction(cb->currentFunctionEntry);
+    if(begin)
+        LLVMPositionBuilderBefore(cb->builder, begin);
+    else
+        LLVMPositionBuilderAtEnd(cb->builder, cb->currentFunctionEntry);
+
+    LLVMValueRef frame = LLVMBuildAlloca(cb->builder, gf->contextType, "genframe");
+    LLVMPositionBuilderAtEnd(cb->builder, curblock);
+
+    ac_generator_setup_frame(cb, gf, frame, args);
+
+    *code = gf->code;
+    return frame;
+}
+
+// The same for a direct call stored into a variable that does not escape
+// (see ac_build_store). The variable still holds an ordinary generator,
+// but one that lives in a counted object on the stack, so every use of it
+// compiles as before while the optimizer sees the whole frame
+LLVMValueRef ac_generator_stack_object(AST *ast, CompilerBundle *cb)
+{
+    LLVMValueRef args[ac_generator_arg_count(ast) + 1];
+    GeneratorFrame *gf = ac_generator_direct_call(ast, cb, args);
+    if(!gf)
+        return NULL;
+
+    LLVMValueRef obj = ac_alloc_counted_stack(cb, gf->countedType);
+    ac_set_teardown(cb, obj, gf->destructor);
+
+    LLVMValueRef ctx = LLVMBuildStructGEP(cb->builder, obj, ET_COUNTED_PAYLOAD, "");
+    ac_generator_setup_frame(cb, gf, ctx, args);
+
+    return LLVMBuildBitCast(cb->builder, obj, ett_llvm_type(gf->type->retType), "");
+}
+
+void ac_generator_release_frame(CompilerBundle *cb, LLVMValueRef frame)
+{
+    ac_generator_release_fields(cb, frame);
+}
+
+void ac_generator_free_frame(void *key, void *val, void *data)
+{
+    GeneratorFrame *gf = val;
+    free(gf->param_fields);
+    free(gf);
 }
 
 void ac_compile_generator_code(AST *ast, CompilerBundle *cb)//, LLVMValueRef func, EagleFunctionType *ft)
@@ -262,7 +403,21 @@ void ac_compile_generator_code(AST *ast, CompilerBundle *cb)//, LLVMValueRef fun
     //     LLVMBuildRetVoid(cb->builder);
     // }
 
-    ac_compile_generator_init(ast, cb, &gb);
+    // Kept for the rest of the module: loops over the generator set up
+    // frames of their own
+    GeneratorFrame *gf = malloc(sizeof(GeneratorFrame));
+    gf->ident = a->ident;
+    gf->init = vs_get(cb->varScope, a->ident)->value;
+    gf->code = func;
+    gf->contextType = ctx;
+    gf->type = (EagleFunctionType *)vs_get(cb->varScope, a->ident)->type;
+    gf->param_fields = malloc((ct + 1) * sizeof(int));
+    for(i = 0; i < ct; i++)
+        gf->param_fields[i] = (int)(uintptr_t)hst_get(&prms, (void *)(uintptr_t)(i + 1), ahhd, ahed);
+
+    hst_put(&cb->generatorFrames, a->ident, gf, NULL, NULL);
+
+    ac_compile_generator_init(ast, cb, gf);
 
     // ac_dump_allocas(cb->currentFunctionEntry, cb);
 
@@ -273,6 +428,7 @@ void ac_compile_generator_code(AST *ast, CompilerBundle *cb)//, LLVMValueRef fun
     hst_free(&prms);
 
     cb->currentFunctionEntry = NULL;
+    cb->yieldBlocks = NULL;
 
     // EagleComplexType *types[] = {ett_pointer_type(ett_base_type(ETInt8)), ett_pointer_type(ett_base_type(ETInt32))};
     // vs_put(cb->varScope, "__gen_test_code", func, ett_function_type(ett_base_type(ETInt1), types, 2));
@@ -359,13 +515,17 @@ void ac_generator_replace_allocas(CompilerBundle *cb, GeneratorBundle *gb)
         btb = LLVMBuildBitCast(cb->builder, par, LLVMPointerType(ctx, 0), "");
     }
 
+    // The resume point is stored as the index of its yield block rather than
+    // as a block address; unlike indirectbr, a switch leaves the code
+    // function open to inlining into the loops that drive it
     LLVMPositionBuilderAtEnd(cb->builder, cb->currentFunctionEntry);
-    LLVMValueRef jumpps = LLVMBuildLoad(cb->builder, LLVMBuildStructGEP(cb->builder, btb, 1, ""), "");
-    LLVMValueRef jmp = LLVMBuildIndirectBr(cb->builder, jumpps, cb->yieldBlocks->count);
+    LLVMValueRef resume = LLVMBuildLoad(cb->builder, LLVMBuildStructGEP(cb->builder, btb, 1, ""), "");
+    resume = LLVMBuildPtrToInt(cb->builder, resume, LLVMInt32TypeInContext(utl_get_current_context()), "");
+    LLVMValueRef jmp = LLVMBuildSwitch(cb->builder, resume, cb->yieldBlocks->items[0], cb->yieldBlocks->count - 1);
 
     int c;
-    for(c = 0; c < cb->yieldBlocks->count; c++)
-        LLVMAddDestination(jmp, cb->yieldBlocks->items[c]);
+    for(c = 1; c < cb->yieldBlocks->count; c++)
+        LLVMAddCase(jmp, LLVMConstInt(LLVMInt32TypeInContext(utl_get_current_context()), c, 0), cb->yieldBlocks->items[c]);
 
     arr_free(&elems);
 }
@@ -413,8 +573,7 @@ void ac_add_gen_declaration(AST *ast, CompilerBundle *cb)
 
     ASTTypeDecl *genType = (ASTTypeDecl *)a->retType;
 
-    EagleComplexType *ty = ett_pointer_type(ett_gen_type(genType->etype));
-    ((EaglePointerType *)ty)->counted = 1;
+    EagleComplexType *ty = ett_pointer_type_ex(ett_gen_type(genType->etype), 1, 0, 0);
 
     LLVMTypeRef func_type = LLVMFunctionType(ett_llvm_type(ty), param_types, ct, a->vararg);
     LLVMValueRef func = LLVMAddFunction(cb->module, a->ident, func_type);
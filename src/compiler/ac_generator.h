@@ -19,7 +19,6 @@ typedef struct {
     char *ident;
     LLVMValueRef func;
     LLVMTypeRef contextType;
-    LLVMTypeRef countedContextType;
 
     EagleComplexType **eparam_types;
     int epct;
@@ -27,10 +26,26 @@ typedef struct {
     LLVMBasicBlockRef last_block;
 } GeneratorBundle;
 
+// What a compiled generator leaves behind for the loops that use it
+typedef struct {
+    char *ident;
+    LLVMValueRef init;
+    LLVMValueRef code;
+    LLVMValueRef destructor;
+    LLVMTypeRef contextType;
+    LLVMTypeRef countedType;
+    EagleFunctionType *type;
+    int *param_fields;
+} GeneratorFrame;
+
 void ac_generator_replace_allocas(CompilerBundle *cb, GeneratorBundle *gb);
 void ac_compile_generator_code(AST *ast, CompilerBundle *cb);
 void ac_add_gen_declaration(AST *ast, CompilerBundle *cb);
 void ac_null_out_counted(CompilerBundle *cb, GeneratorBundle *gb, LLVMValueRef btb);
-LLVMValueRef ac_compile_generator_init(AST *ast, CompilerBundle *cb, GeneratorBundle *gb);
+LLVMValueRef ac_compile_generator_init(AST *ast, CompilerBundle *cb, GeneratorFrame *gf);
+LLVMValueRef ac_generator_stack_frame(AST *ast, CompilerBundle *cb, LLVMValueRef *code);
+LLVMValueRef ac_generator_stack_object(AST *ast, CompilerBundle *cb);
+void ac_generator_release_frame(CompilerBundle *cb, LLVMValueRef frame);
+void ac_generator_free_frame(void *key, void *val, void *data);
 
 #endif
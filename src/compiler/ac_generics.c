@@ -34,27 +34,27 @@ static GenericBundle *ac_gb_alloc(AST *ast, EagleComplexType *template_type)
     bundle->implementations = hst_create();
     bundle->implementations.duplicate_keys = 1;
 
-    bundle->template_type = template_type;
-
     // We need to replace all of the "tagged" template types with
     // concrete types as the original ones will be replaced later
     // on.
     EagleFunctionType *ft = (EagleFunctionType *)template_type;
+    EagleComplexType *params[ft->pct + 1];
     for(int i = 0; i < ft->pct; i++)
     {
         EagleComplexType *param = ft->params[i];
         if(ett_qualifies_as_generic(param))
-        {
-            ft->params[i] = ett_deep_copy(ft->params[i]);
-        }
+            param = ett_deep_copy(param);
+        params[i] = param;
     }
 
     EagleComplexType *rt = ft->retType;
     if(ett_qualifies_as_generic(rt))
     {
-        ft->retType = ett_deep_copy(ft->retType);
+        rt = ett_deep_copy(rt);
     }
-    
+
+    bundle->template_type = ett_function_type_ex(rt, params, ft->pct, ft->closure, ft->variadic, ft->gen);
+
     return bundle;
 }
 
@@ -92,12 +92,16 @@ int ac_decl_is_generic(AST *ast)
     return ett_qualifies_as_generic(((ASTTypeDecl *)a->retType)->etype);
 }
 
-void ac_generic_register(AST *ast, EagleComplexType *template_type, CompilerBundle *cb)
+// Returns the template with its generic types detached from the shared
+// placeholders
+EagleComplexType *ac_generic_register(AST *ast, EagleComplexType *template_type, CompilerBundle *cb)
 {
     ASTFuncDecl *a = (ASTFuncDecl *)ast;
 
     GenericBundle *gb = ac_gb_alloc(ast, template_type);
     hst_put(&cb->genericFunctions, a->ident, gb, NULL, NULL);
+
+    return gb->template_type;
 }
 
 static void ac_replace_types_each(void *key, void *val, void *data)
@@ -149,11 +153,10 @@ static EagleComplexType *ac_handle_pointer(EagleComplexType *reftype, EagleCompl
             die(lineno, "Pointer types do not match in generic");
     }
 
-    EagleComplexType *out = ett_copy(reftype);
-    EaglePointerType *outp = (EaglePointerType *)out;
+    EagleComplexType *to = refp->to;
+    ac_copy_and_find_types(refp->to, inp ? inp->to : NULL, &to, scanned, lineno);
 
-    ac_copy_and_find_types(refp->to, inp ? inp->to : NULL, &outp->to, scanned, lineno);
-    return out;
+    return ett_pointer_type_ex(to, refp->counted, refp->weak, refp->closed);
 }
 
 static EagleComplexType *ac_handle_function(EagleComplexType *reftype, EagleComplexType *intype, Hashtable *scanned, int lineno)
@@ -171,14 +174,15 @@ static EagleComplexType *ac_handle_function(EagleComplexType *reftype, EagleComp
             die(lineno, "Function types do not match in generic function pointer");
     }
 
-    EagleComplexType *out = ett_copy(reftype);
-    EagleFunctionType *outf = (EagleFunctionType *)out;
+    EagleComplexType *params[reff->pct + 1];
+    EagleComplexType *ret = reff->retType;
+    memcpy(params, reff->params, sizeof(EagleComplexType *) * reff->pct);
 
-    for(int i = 0; i < outf->pct; i++)
-        ac_copy_and_find_types(reff->params[i], inf ? inf->params[i] : NULL, &outf->params[i], scanned, lineno);
-    ac_copy_and_find_types(reff->retType, inf ? inf->retType : NULL, &outf->retType, scanned, lineno);
+    for(int i = 0; i < reff->pct; i++)
+        ac_copy_and_find_types(reff->params[i], inf ? inf->params[i] : NULL, &params[i], scanned, lineno);
+    ac_copy_and_find_types(reff->retType, inf ? inf->retType : NULL, &ret, scanned, lineno);
 
-    return out;
+    return ett_function_type_ex(ret, params, reff->pct, reff->closure, reff->variadic, reff->gen);
 }
 
 static void
@@ -238,9 +242,7 @@ LLVMValueRef ac_generic_get(char *func, EagleComplexType *arguments[], EagleComp
 
             new_args[i] = given;
 
-            char *type = ett_unique_type_name(replacement_type);
-            sb_append(&sbd, type);
-            free(type);
+            sb_append(&sbd, ett_unique_type_name(replacement_type));
         }
     }
 
@@ -44,10 +44,7 @@ LLVMValueRef ac_try_view_conversion(CompilerBundle *cb, LLVMValueRef val, EagleC
     char *type_name = ett_unique_type_name(to);
 
     if(!ty_method_lookup(st->name, type_name))
-    {
-        free(type_name);
         return NULL;
-    }
 
     char *method = ac_gen_method_name(st->name, type_name);
 
@@ -55,7 +52,6 @@ LLVMValueRef ac_try_view_conversion(CompilerBundle *cb, LLVMValueRef val, EagleC
     LLVMValueRef call = LLVMBuildCall(cb->builder, func, &val, 1, "convertable");
 
     free(method);
-    free(type_name);
 
     return call;
 }
@@ -498,15 +494,19 @@ void ac_replace_with_counted(CompilerBundle *cb, VarBundle *b)
     LLVMValueRef mal = ac_compile_malloc_counted(b->type, &b->type, val, cb);
     LLVMValueRef pos = LLVMBuildAlloca(cb->builder, ett_llvm_type(b->type), "");
     LLVMBuildStore(cb->builder, mal, pos);
-    ac_incr_pointer(cb, &pos, b->type);
 
-    ((EaglePointerType *)b->type)->closed = 1;
+    // The allocation is fresh, so there is no need for a checked increment;
+    // just give it its first reference
+    LLVMValueRef count = LLVMBuildStructGEP(cb->builder, mal, 0, "");
+    LLVMBuildStore(cb->builder, LLVMConstInt(LLVMInt32TypeInContext(utl_get_current_context()), 1, 0), count);
+
+    b->type = ett_pointer_type_ex(ET_POINTEE(b->type), 1, 0, 1);
 
     b->value = pos;
     b->scopeCallback = ac_scope_leave_callback;
     b->scopeData = cb;
 
-    LLVMValueRef to = LLVMBuildStructGEP(cb->builder, mal, 5, "");
+    LLVMValueRef to = LLVMBuildStructGEP(cb->builder, mal, ET_COUNTED_PAYLOAD, "");
     LLVMReplaceAllUsesWith(val, to);
     LLVMInstructionEraseFromParent(val);
 
@@ -7,6 +7,14 @@
  */
 
 #include "ast_compiler.h"
+#include "core/intern.h"
+
+extern Hashtable global_args;
+
+// Size classes of the runtime's pool allocator. Must match rc.egl
+#define POOL_CLASSES 8
+#define POOL_CLASS_SHIFT 8
+static const int pool_sizes[POOL_CLASSES] = {16, 32, 48, 64, 96, 128, 192, 256};
 
 void ac_scope_leave_callback(LLVMValueRef pos, EagleComplexType *ty, void *data)
 {
@@ -26,6 +34,12 @@ void ac_scope_leave_weak_callback(LLVMValueRef pos, EagleComplexType *ty, void *
     ac_remove_weak_pointer(cb, pos, ty);
 }
 
+void ac_scope_leave_stack_callback(LLVMValueRef pos, EagleComplexType *ty, void *data)
+{
+    CompilerBundle *cb = data;
+    ac_teardown_stack_object(cb, LLVMBuildLoad(cb->builder, pos, ""));
+}
+
 void ac_decr_loaded_transients(void *key, void *val, void *data)
 {
     CompilerBundle *cb = data;
@@ -47,6 +61,222 @@ void ac_decr_transients(void *key, void *val, void *data)
     ac_check_pointer(cb, &pos, ast->resultantType);
 }
 
+// The count manipulation is emitted into every module as small private
+// functions that are always inlined, so that the optimizer can see (and
+// fold) it and the RC elision pass can still recognize each operation as a
+// single call. Only releasing an object calls into the runtime. All helpers
+// take a pointer to the memcount field at the head of the object.
+static LLVMValueRef ac_rc_begin_helper(LLVMModuleRef module, LLVMBuilderRef builder, const char *name, LLVMBasicBlockRef *mergeBB)
+{
+    LLVMContextRef ctx = utl_get_current_context();
+    LLVMTypeRef param = LLVMPointerType(LLVMInt32TypeInContext(ctx), 0);
+    LLVMValueRef func = LLVMAddFunction(module, name, LLVMFunctionType(LLVMVoidTypeInContext(ctx), &param, 1, 0));
+    LLVMSetLinkage(func, LLVMPrivateLinkage);
+    EGLSetAlwaysInline(func);
+
+    LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(ctx, func, "entry");
+    LLVMBasicBlockRef loadBB = LLVMAppendBasicBlockInContext(ctx, func, "load");
+    *mergeBB = LLVMAppendBasicBlockInContext(ctx, func, "merge");
+
+    LLVMPositionBuilderAtEnd(builder, *mergeBB);
+    LLVMBuildRetVoid(builder);
+
+    LLVMPositionBuilderAtEnd(builder, entry);
+    LLVMBuildCondBr(builder, LLVMBuildIsNotNull(builder, LLVMGetParam(func, 0), ""), loadBB, *mergeBB);
+    LLVMPositionBuilderAtEnd(builder, loadBB);
+
+    return func;
+}
+
+static void ac_rc_build_release(LLVMModuleRef module, LLVMBuilderRef builder, LLVMValueRef func, LLVMValueRef dead, LLVMBasicBlockRef mergeBB)
+{
+    LLVMBasicBlockRef releaseBB = LLVMAppendBasicBlockInContext(utl_get_current_context(), func, "release");
+    LLVMBuildCondBr(builder, dead, releaseBB, mergeBB);
+
+    LLVMPositionBuilderAtEnd(builder, releaseBB);
+    LLVMValueRef tptr = LLVMGetParam(func, 0);
+    LLVMBuildCall(builder, LLVMGetNamedFunction(module, "__egl_release_ptr"), &tptr, 1, "");
+    LLVMBuildBr(builder, mergeBB);
+}
+
+// With --rc=atomic every count update is a single atomic operation, so
+// counted objects may be shared between threads. The decrement that drops
+// the last reference is acquire-release so that the thread freeing the
+// object sees every write made by the threads that let go of it first.
+int ac_rc_is_atomic()
+{
+    return hst_get(&global_args, (char *)"--rc=atomic", NULL, NULL) != NULL;
+}
+
+static LLVMValueRef ac_rc_load(LLVMBuilderRef builder, LLVMValueRef tptr, LLVMAtomicOrdering order)
+{
+    LLVMValueRef count = LLVMBuildLoad(builder, tptr, "count");
+    if(ac_rc_is_atomic())
+    {
+        LLVMSetOrdering(count, order);
+        LLVMSetAlignment(count, 4);
+    }
+
+    return count;
+}
+
+void ac_add_rc_helpers(LLVMModuleRef module)
+{
+    LLVMContextRef ctx = utl_get_current_context();
+    LLVMTypeRef i32 = LLVMInt32TypeInContext(ctx);
+    LLVMBuilderRef builder = LLVMCreateBuilderInContext(ctx);
+    LLVMBasicBlockRef mergeBB;
+    int atomic = ac_rc_is_atomic();
+
+    // Objects at or below ET_COUNT_IMMORTAL are never freed
+    LLVMValueRef func = ac_rc_begin_helper(module, builder, "__egl_rc_incr", &mergeBB);
+    LLVMValueRef tptr = LLVMGetParam(func, 0);
+    LLVMValueRef count = ac_rc_load(builder, tptr, LLVMAtomicOrderingMonotonic);
+    LLVMBasicBlockRef incrBB = LLVMAppendBasicBlockInContext(ctx, func, "incr");
+    LLVMBuildCondBr(builder, LLVMBuildICmp(builder, LLVMIntSGT, count, LLVMConstInt(i32, ET_COUNT_IMMORTAL, 1), ""), incrBB, mergeBB);
+    LLVMPositionBuilderAtEnd(builder, incrBB);
+    if(atomic)
+        LLVMBuildAtomicRMW(builder, LLVMAtomicRMWBinOpAdd, tptr, LLVMConstInt(i32, 1, 0), LLVMAtomicOrderingMonotonic, 0);
+    else
+        LLVMBuildStore(builder, LLVMBuildAdd(builder, count, LLVMConstInt(i32, 1, 0), ""), tptr);
+    LLVMBuildBr(builder, mergeBB);
+
+    // Negative counts mark objects that are being torn down
+    func = ac_rc_begin_helper(module, builder, "__egl_rc_decr", &mergeBB);
+    tptr = LLVMGetParam(func, 0);
+    count = ac_rc_load(builder, tptr, LLVMAtomicOrderingMonotonic);
+    LLVMBasicBlockRef decrBB = LLVMAppendBasicBlockInContext(ctx, func, "decr");
+    LLVMBuildCondBr(builder, LLVMBuildICmp(builder, LLVMIntSGE, count, LLVMConstInt(i32, 0, 1), ""), decrBB, mergeBB);
+    LLVMPositionBuilderAtEnd(builder, decrBB);
+    LLVMValueRef dead;
+    if(atomic)
+    {
+        LLVMValueRef prev = LLVMBuildAtomicRMW(builder, LLVMAtomicRMWBinOpSub, tptr, LLVMConstInt(i32, 1, 0), LLVMAtomicOrderingAcquireRelease, 0);
+        dead = LLVMBuildICmp(builder, LLVMIntEQ, prev, LLVMConstInt(i32, 1, 0), "");
+    }
+    else
+    {
+        LLVMValueRef next = LLVMBuildSub(builder, count, LLVMConstInt(i32, 1, 0), "");
+        LLVMBuildStore(builder, next, tptr);
+        dead = LLVMBuildICmp(builder, LLVMIntEQ, next, LLVMConstInt(i32, 0, 0), "");
+    }
+    ac_rc_build_release(module, builder, func, dead, mergeBB);
+
+    func = ac_rc_begin_helper(module, builder, "__egl_rc_check", &mergeBB);
+    tptr = LLVMGetParam(func, 0);
+    count = ac_rc_load(builder, tptr, LLVMAtomicOrderingAcquire);
+    ac_rc_build_release(module, builder, func, LLVMBuildICmp(builder, LLVMIntEQ, count, LLVMConstInt(i32, 0, 0), ""), mergeBB);
+
+    LLVMDisposeBuilder(builder);
+}
+
+static LLVMValueRef ac_rc_begin_primitive(CompilerBundle *cb, const char *name, LLVMTypeRef type, EagleComplexType *ety)
+{
+    LLVMValueRef func = LLVMAddFunction(cb->module, name, type);
+    LLVMSetLinkage(func, LLVMPrivateLinkage);
+    EGLSetAlwaysInline(func);
+
+    vs_put(cb->varScope, in_intern(name), func, ety, -1);
+
+    LLVMPositionBuilderAtEnd(cb->builder, LLVMAppendBasicBlockInContext(utl_get_current_context(), func, "entry"));
+
+    return func;
+}
+
+// The runtime keeps its own counts and weak reference lists, which have to
+// follow the same threading rules as the code the compiler emits. These are
+// made visible to it as ordinary functions:
+//
+//   __egl_rc_load(int*) : int        reads a count
+//   __egl_rc_add(int*, int) : int    adjusts a count, returns the new one
+//   __egl_rc_lock(int*)              spins until the lock is taken
+//   __egl_rc_unlock(int*)
+//   __egl_pool_cache() : any**       this thread's free lists, by size class
+//
+// Locking compiles to nothing when counting is not atomic.
+void ac_add_rc_primitives(CompilerBundle *cb)
+{
+    LLVMContextRef ctx = utl_get_current_context();
+    LLVMTypeRef i32 = LLVMInt32TypeInContext(ctx);
+    LLVMBuilderRef builder = cb->builder;
+    int atomic = ac_rc_is_atomic();
+
+    EagleComplexType *ecount = ett_pointer_type(ett_base_type(ETInt32));
+    EagleComplexType *eparams[] = {ecount, ett_base_type(ETInt32)};
+
+    LLVMTypeRef params[] = {LLVMPointerType(i32, 0), i32};
+    LLVMValueRef func = ac_rc_begin_primitive(cb, "__egl_rc_load", LLVMFunctionType(i32, params, 1, 0),
+                                              ett_function_type(ett_base_type(ETInt32), eparams, 1));
+    LLVMBuildRet(builder, ac_rc_load(builder, LLVMGetParam(func, 0), LLVMAtomicOrderingAcquire));
+
+    func = ac_rc_begin_primitive(cb, "__egl_rc_add", LLVMFunctionType(i32, params, 2, 0),
+                                 ett_function_type(ett_base_type(ETInt32), eparams, 2));
+    LLVMValueRef tptr = LLVMGetParam(func, 0);
+    LLVMValueRef delta = LLVMGetParam(func, 1);
+    if(atomic)
+    {
+        LLVMValueRef prev = LLVMBuildAtomicRMW(builder, LLVMAtomicRMWBinOpAdd, tptr, delta, LLVMAtomicOrderingAcquireRelease, 0);
+        LLVMBuildRet(builder, LLVMBuildAdd(builder, prev, delta, ""));
+    }
+    else
+    {
+        LLVMValueRef next = LLVMBuildAdd(builder, LLVMBuildLoad(builder, tptr, "count"), delta, "");
+        LLVMBuildStore(builder, next, tptr);
+        LLVMBuildRet(builder, next);
+    }
+
+    LLVMTypeRef locktype = LLVMFunctionType(LLVMVoidTypeInContext(ctx), params, 1, 0);
+    EagleComplexType *elocktype = ett_function_type(ett_base_type(ETVoid), &ecount, 1);
+
+    func = ac_rc_begin_primitive(cb, "__egl_rc_lock", locktype, elocktype);
+    if(atomic)
+    {
+        LLVMBasicBlockRef spinBB = LLVMAppendBasicBlockInContext(ctx, func, "spin");
+        LLVMBasicBlockRef doneBB = LLVMAppendBasicBlockInContext(ctx, func, "done");
+        LLVMBuildBr(builder, spinBB);
+        LLVMPositionBuilderAtEnd(builder, spinBB);
+        LLVMValueRef held = LLVMBuildAtomicRMW(builder, LLVMAtomicRMWBinOpXchg, LLVMGetParam(func, 0), LLVMConstInt(i32, 1, 0), LLVMAtomicOrderingAcquire, 0);
+        LLVMBuildCondBr(builder, LLVMBuildIsNull(builder, held, ""), doneBB, spinBB);
+        LLVMPositionBuilderAtEnd(builder, doneBB);
+    }
+    LLVMBuildRetVoid(builder);
+
+    func = ac_rc_begin_primitive(cb, "__egl_rc_unlock", locktype, elocktype);
+    if(atomic)
+    {
+        LLVMValueRef store = LLVMBuildStore(builder, LLVMConstInt(i32, 0, 0), LLVMGetParam(func, 0));
+        LLVMSetOrdering(store, LLVMAtomicOrderingRelease);
+        LLVMSetAlignment(store, 4);
+    }
+    LLVMBuildRetVoid(builder);
+
+    LLVMTypeRef i8pp = LLVMPointerType(LLVMPointerType(LLVMInt8TypeInContext(ctx), 0), 0);
+    LLVMTypeRef cachetype = LLVMArrayType(LLVMGetElementType(i8pp), POOL_CLASSES + 1);
+    LLVMValueRef cache = LLVMAddGlobal(cb->module, cachetype, "__egl_pool_free_lists");
+    LLVMSetLinkage(cache, LLVMPrivateLinkage);
+    LLVMSetThreadLocal(cache, 1);
+    LLVMSetInitializer(cache, LLVMConstNull(cachetype));
+
+    func = ac_rc_begin_primitive(cb, "__egl_pool_cache", LLVMFunctionType(i8pp, NULL, 0, 0),
+                                 ett_function_type(ett_pointer_type(ett_pointer_type(ett_base_type(ETAny))), NULL, 0));
+    LLVMBuildRet(builder, LLVMBuildBitCast(builder, cache, i8pp, ""));
+}
+
+static void ac_rc_build_incr(CompilerBundle *cb, LLVMValueRef tptr)
+{
+    LLVMBuildCall(cb->builder, LLVMGetNamedFunction(cb->module, "__egl_rc_incr"), &tptr, 1, "");
+}
+
+static void ac_rc_build_decr(CompilerBundle *cb, LLVMValueRef tptr)
+{
+    LLVMBuildCall(cb->builder, LLVMGetNamedFunction(cb->module, "__egl_rc_decr"), &tptr, 1, "");
+}
+
+static void ac_rc_build_check(CompilerBundle *cb, LLVMValueRef tptr)
+{
+    LLVMBuildCall(cb->builder, LLVMGetNamedFunction(cb->module, "__egl_rc_check"), &tptr, 1, "");
+}
+
 void ac_unwrap_pointer(CompilerBundle *cb, LLVMValueRef *ptr, EagleComplexType *ty, int keepptr)
 {
     if(ty)
@@ -58,7 +288,7 @@ void ac_unwrap_pointer(CompilerBundle *cb, LLVMValueRef *ptr, EagleComplexType *
 
     LLVMValueRef tptr = *ptr;//LLVMBuildLoad(cb->builder, *ptr, "tptr");
 
-    LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, tptr, 5, "unwrap");
+    LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, tptr, ET_COUNTED_PAYLOAD, "unwrap");
 
     *ptr = pos;
 }
@@ -75,10 +305,9 @@ void ac_incr_val_pointer(CompilerBundle *cb, LLVMValueRef *ptr, EagleComplexType
     }
 
     LLVMValueRef tptr = *ptr;
-    tptr = LLVMBuildBitCast(builder, tptr, LLVMPointerType(LLVMInt64TypeInContext(utl_get_current_context()), 0), "cast");
+    tptr = LLVMBuildBitCast(builder, tptr, LLVMPointerType(LLVMInt32TypeInContext(utl_get_current_context()), 0), "cast");
 
-    LLVMValueRef func = LLVMGetNamedFunction(cb->module, "__egl_incr_ptr");
-    LLVMBuildCall(builder, func, &tptr, 1, "");
+    ac_rc_build_incr(cb, tptr);
 }
 
 void ac_incr_pointer(CompilerBundle *cb, LLVMValueRef *ptr, EagleComplexType *ty)
@@ -93,10 +322,9 @@ void ac_incr_pointer(CompilerBundle *cb, LLVMValueRef *ptr, EagleComplexType *ty
     }
 
     LLVMValueRef tptr = LLVMBuildLoad(builder, *ptr, "tptr");
-    tptr = LLVMBuildBitCast(builder, tptr, LLVMPointerType(LLVMInt64TypeInContext(utl_get_current_context()), 0), "cast");
+    tptr = LLVMBuildBitCast(builder, tptr, LLVMPointerType(LLVMInt32TypeInContext(utl_get_current_context()), 0), "cast");
 
-    LLVMValueRef func = LLVMGetNamedFunction(cb->module, "__egl_incr_ptr");
-    LLVMBuildCall(builder, func, &tptr, 1, "");
+    ac_rc_build_incr(cb, tptr);
 }
 
 void ac_check_pointer(CompilerBundle *cb, LLVMValueRef *ptr, EagleComplexType *ty)
@@ -105,19 +333,136 @@ void ac_check_pointer(CompilerBundle *cb, LLVMValueRef *ptr, EagleComplexType *t
     if(!pt->counted)
         return;
 
-    LLVMValueRef tptr = LLVMBuildBitCast(cb->builder, *ptr, LLVMPointerType(LLVMInt64TypeInContext(utl_get_current_context()), 0), "");
-    LLVMValueRef func = LLVMGetNamedFunction(cb->module, "__egl_check_ptr");
-    LLVMBuildCall(cb->builder, func, &tptr, 1, "");
+    LLVMValueRef tptr = LLVMBuildBitCast(cb->builder, *ptr, LLVMPointerType(LLVMInt32TypeInContext(utl_get_current_context()), 0), "");
+    ac_rc_build_check(cb, tptr);
 }
 
-void ac_prepare_pointer(CompilerBundle *cb, LLVMValueRef ptr, EagleComplexType *ty)
+static void ac_prepare_pointer(CompilerBundle *cb, LLVMValueRef ptr, int count, int flags)
 {
-    if(ty && !ET_IS_COUNTED(ty))
-        return;
+    LLVMContextRef ctx = utl_get_current_context();
+    LLVMTypeRef header = ty_counted_header();
+    LLVMValueRef vals[] = {
+        LLVMConstInt(LLVMInt32TypeInContext(ctx), count, 1),
+        LLVMConstInt(LLVMInt32TypeInContext(ctx), flags, 0),
+        LLVMConstPointerNull(LLVMPointerType(ty_type_descriptor(), 0))
+    };
+
+    LLVMValueRef tptr = LLVMBuildBitCast(cb->builder, ptr, LLVMPointerType(header, 0), "");
+    LLVMBuildStore(cb->builder, LLVMConstNamedStruct(header, vals, 3), tptr);
+}
+
+// With --alloc=pool, objects that fit one of the runtime's size classes are
+// taken from its thread-local free lists through __egl_alloc_<size>, and
+// the class is kept in the header flags so that releasing the object can
+// hand it back. Everything else comes from malloc.
+static int ac_pool_class(CompilerBundle *cb, LLVMTypeRef tt)
+{
+    if(!hst_get(&global_args, (char *)"--alloc=pool", NULL, NULL))
+        return 0;
+
+    unsigned long long size = LLVMABISizeOfType(cb->td, tt);
 
-    LLVMValueRef tptr = LLVMBuildBitCast(cb->builder, ptr, LLVMPointerType(LLVMInt64TypeInContext(utl_get_current_context()), 0), "");
-    LLVMValueRef func = LLVMGetNamedFunction(cb->module, "__egl_prepare");
-    LLVMBuildCall(cb->builder, func, &tptr, 1, "");
+    int i;
+    for(i = 0; i < POOL_CLASSES; i++)
+        if(size <= (unsigned long long)pool_sizes[i])
+            return i + 1;
+
+    return 0;
+}
+
+// Allocates a counted object of type tt (header included) and sets up its
+// header. The builder must already be positioned before ib, if given
+LLVMValueRef ac_alloc_counted(CompilerBundle *cb, LLVMTypeRef tt, LLVMValueRef ib)
+{
+    int cls = ac_pool_class(cb, tt);
+
+    LLVMValueRef mal;
+    if(cls)
+    {
+        char name[32];
+        sprintf(name, "__egl_alloc_%d", pool_sizes[cls - 1]);
+
+        LLVMValueRef func = LLVMGetNamedFunction(cb->module, name);
+        if(!func)
+            func = LLVMAddFunction(cb->module, name, LLVMFunctionType(LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0), NULL, 0, 0));
+
+        mal = LLVMBuildBitCast(cb->builder, LLVMBuildCall(cb->builder, func, NULL, 0, ""), LLVMPointerType(tt, 0), "new");
+    }
+    else if(ib)
+        mal = EGLBuildMalloc(cb->builder, tt, ib, "new");
+    else
+        mal = LLVMBuildMalloc(cb->builder, tt, "new");
+
+    ac_prepare_pointer(cb, mal, 0, cls << POOL_CLASS_SHIFT);
+
+    return mal;
+}
+
+// Counted objects that cannot outlive the variable holding them (see
+// ac_escape.c) live in the entry block of the current function. They are
+// immortal as far as the counts go; leaving the scope of the variable
+// tears them down instead (ac_scope_leave_stack_callback)
+LLVMValueRef ac_alloc_counted_stack(CompilerBundle *cb, LLVMTypeRef tt)
+{
+    LLVMBasicBlockRef curblock = LLVMGetInsertBlock(cb->builder);
+    LLVMValueRef begin = LLVMGetFirstInstruction(cb->currentFunctionEntry);
+    if(begin)
+        LLVMPositionBuilderBefore(cb->builder, begin);
+    else
+        LLVMPositionBuilderAtEnd(cb->builder, cb->currentFunctionEntry);
+
+    LLVMValueRef obj = LLVMBuildAlloca(cb->builder, tt, "stacknew");
+    LLVMPositionBuilderAtEnd(cb->builder, curblock);
+
+    ac_prepare_pointer(cb, obj, ET_COUNT_IMMORTAL, 0);
+
+    return obj;
+}
+
+void ac_teardown_stack_object(CompilerBundle *cb, LLVMValueRef obj)
+{
+    LLVMContextRef ctx = utl_get_current_context();
+
+    obj = LLVMBuildBitCast(cb->builder, obj, LLVMPointerType(ty_counted_header(), 0), "");
+    LLVMValueRef desc = LLVMBuildLoad(cb->builder, LLVMBuildStructGEP(cb->builder, obj, ET_COUNTED_DESC, ""), "");
+
+    LLVMBasicBlockRef teardownBB = LLVMAppendBasicBlockInContext(ctx, cb->currentFunction, "teardown");
+    LLVMBasicBlockRef mergeBB = LLVMAppendBasicBlockInContext(ctx, cb->currentFunction, "merge");
+    LLVMBuildCondBr(cb->builder, LLVMBuildIsNotNull(cb->builder, desc, ""), teardownBB, mergeBB);
+
+    LLVMPositionBuilderAtEnd(cb->builder, teardownBB);
+    LLVMValueRef args[2];
+    args[0] = LLVMBuildBitCast(cb->builder, obj, LLVMPointerType(LLVMInt8TypeInContext(ctx), 0), "");
+    args[1] = LLVMConstInt(LLVMInt1TypeInContext(ctx), 1, 0);
+    LLVMValueRef teardown = LLVMBuildLoad(cb->builder, LLVMBuildStructGEP(cb->builder, desc, 0, ""), "");
+    LLVMBuildCall(cb->builder, teardown, args, 2, "");
+    LLVMBuildBr(cb->builder, mergeBB);
+
+    LLVMPositionBuilderAtEnd(cb->builder, mergeBB);
+}
+
+// Objects of one type share a descriptor, found through the teardown
+// function the runtime calls when releasing them
+void ac_set_teardown(CompilerBundle *cb, LLVMValueRef obj, LLVMValueRef teardown)
+{
+    const char *fname = LLVMGetValueName(teardown);
+    char *name = malloc(strlen(fname) + 12);
+    sprintf(name, "__egl_desc_%s", fname);
+
+    LLVMValueRef desc = LLVMGetNamedGlobal(cb->module, name);
+    if(!desc)
+    {
+        LLVMTypeRef ty = ty_type_descriptor();
+        desc = LLVMAddGlobal(cb->module, ty, name);
+        LLVMSetLinkage(desc, LLVMPrivateLinkage);
+        LLVMSetGlobalConstant(desc, 1);
+        LLVMSetInitializer(desc, LLVMConstNamedStruct(ty, &teardown, 1));
+    }
+
+    free(name);
+
+    LLVMValueRef pos = LLVMBuildStructGEP(cb->builder, obj, ET_COUNTED_DESC, "");
+    LLVMBuildStore(cb->builder, desc, pos);
 }
 
 void ac_add_weak_pointer(CompilerBundle *cb, LLVMValueRef ptr, LLVMValueRef weak, EagleComplexType *ty)
@@ -126,7 +471,7 @@ void ac_add_weak_pointer(CompilerBundle *cb, LLVMValueRef ptr, LLVMValueRef weak
         return;
 
     LLVMValueRef vals[2];
-    vals[0] = LLVMBuildBitCast(cb->builder, ptr, LLVMPointerType(LLVMInt64TypeInContext(utl_get_current_context()), 0), "");
+    vals[0] = LLVMBuildBitCast(cb->builder, ptr, LLVMPointerType(LLVMInt32TypeInContext(utl_get_current_context()), 0), "");
     vals[1] = LLVMBuildBitCast(cb->builder, weak, LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0), "");
     LLVMValueRef func = LLVMGetNamedFunction(cb->module, "__egl_add_weak");
     LLVMBuildCall(cb->builder, func, vals, 2, "");
@@ -153,10 +498,9 @@ void ac_decr_val_pointer(CompilerBundle *cb, LLVMValueRef *ptr, EagleComplexType
     }
 
     LLVMValueRef tptr = *ptr;
-    tptr = LLVMBuildBitCast(builder, tptr, LLVMPointerType(LLVMInt64TypeInContext(utl_get_current_context()), 0), "cast");
+    tptr = LLVMBuildBitCast(builder, tptr, LLVMPointerType(LLVMInt32TypeInContext(utl_get_current_context()), 0), "cast");
 
-    LLVMValueRef func = LLVMGetNamedFunction(cb->module, "__egl_decr_ptr");
-    LLVMBuildCall(builder, func, &tptr, 1, "");
+    ac_rc_build_decr(cb, tptr);
 }
 
 void ac_decr_val_pointer_no_free(CompilerBundle *cb, LLVMValueRef *ptr, EagleComplexType *ty)
@@ -170,10 +514,17 @@ void ac_decr_val_pointer_no_free(CompilerBundle *cb, LLVMValueRef *ptr, EagleCom
     }
 
     LLVMValueRef tptr = *ptr;
-    tptr = LLVMBuildBitCast(builder, tptr, LLVMPointerType(LLVMInt64TypeInContext(utl_get_current_context()), 0), "cast");
+    tptr = LLVMBuildBitCast(builder, tptr, LLVMPointerType(LLVMInt32TypeInContext(utl_get_current_context()), 0), "cast");
+
+    LLVMValueRef one = LLVMConstInt(LLVMInt32TypeInContext(utl_get_current_context()), 1, 0);
+    if(ac_rc_is_atomic())
+    {
+        LLVMBuildAtomicRMW(builder, LLVMAtomicRMWBinOpSub, tptr, one, LLVMAtomicOrderingRelease, 0);
+        return;
+    }
 
-    LLVMValueRef func = LLVMGetNamedFunction(cb->module, "__egl_decr_no_free");
-    LLVMBuildCall(builder, func, &tptr, 1, "");
+    LLVMValueRef count = LLVMBuildLoad(builder, tptr, "count");
+    LLVMBuildStore(builder, LLVMBuildSub(builder, count, one, ""), tptr);
 }
 
 void ac_nil_fill_array(CompilerBundle *cb, LLVMValueRef arr, int ct)
@@ -208,8 +559,7 @@ void ac_decr_pointer(CompilerBundle *cb, LLVMValueRef *ptr, EagleComplexType *ty
     }
 
     LLVMValueRef tptr = LLVMBuildLoad(builder, *ptr, "tptr");
-    tptr = LLVMBuildBitCast(builder, tptr, LLVMPointerType(LLVMInt64TypeInContext(utl_get_current_context()), 0), "cast");
+    tptr = LLVMBuildBitCast(builder, tptr, LLVMPointerType(LLVMInt32TypeInContext(utl_get_current_context()), 0), "cast");
 
-    LLVMValueRef func = LLVMGetNamedFunction(cb->module, "__egl_decr_ptr");
-    LLVMBuildCall(builder, func, &tptr, 1, "");
+    ac_rc_build_decr(cb, tptr);
 }
@@ -12,10 +12,17 @@
 void ac_scope_leave_callback(LLVMValueRef pos, EagleComplexType *ty, void *data);
 void ac_scope_leave_array_callback(LLVMValueRef pos, EagleComplexType *ty, void *data);
 void ac_scope_leave_weak_callback(LLVMValueRef pos, EagleComplexType *ty, void *data);
+void ac_scope_leave_stack_callback(LLVMValueRef pos, EagleComplexType *ty, void *data);
 void ac_decr_loaded_transients(void *key, void *val, void *data);
 void ac_decr_transients(void *key, void *val, void *data);
+int ac_rc_is_atomic();
+void ac_add_rc_helpers(LLVMModuleRef module);
+void ac_add_rc_primitives(CompilerBundle *cb);
 void ac_unwrap_pointer(CompilerBundle *cb, LLVMValueRef *ptr, EagleComplexType *ty, int keepptr);
-void ac_prepare_pointer(CompilerBundle *cb, LLVMValueRef ptr, EagleComplexType *ty);
+LLVMValueRef ac_alloc_counted(CompilerBundle *cb, LLVMTypeRef tt, LLVMValueRef ib);
+LLVMValueRef ac_alloc_counted_stack(CompilerBundle *cb, LLVMTypeRef tt);
+void ac_teardown_stack_object(CompilerBundle *cb, LLVMValueRef obj);
+void ac_set_teardown(CompilerBundle *cb, LLVMValueRef obj, LLVMValueRef teardown);
 void ac_incr_pointer(CompilerBundle *cb, LLVMValueRef *ptr, EagleComplexType *ty);
 void ac_incr_val_pointer(CompilerBundle *cb, LLVMValueRef *ptr, EagleComplexType *ty);
 void ac_check_pointer(CompilerBundle *cb, LLVMValueRef *ptr, EagleComplexType *ty);
@@ -152,8 +152,9 @@ void ac_make_struct_destructor(AST *ast, CompilerBundle *cb)
     LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(utl_get_current_context(), func, "entry");
     LLVMPositionBuilderAtEnd(cb->builder, entry);
 
-    EaglePointerType *ett = (EaglePointerType *)ett_pointer_type(ett_struct_type(a->name));
-    LLVMValueRef pos = LLVMBuildAlloca(cb->builder, ett_llvm_type((EagleComplexType *)ett), "");
+    EagleComplexType *ett = ett_pointer_type(ett_struct_type(a->name));
+    EagleComplexType *cett = ett_pointer_type_ex(ett_struct_type(a->name), 1, 0, 0);
+    LLVMValueRef pos = LLVMBuildAlloca(cb->builder, ett_llvm_type(ett), "");
     LLVMValueRef cmp = LLVMBuildICmp(cb->builder, LLVMIntEQ, LLVMGetParam(func, 1), LLVMConstInt(LLVMInt1TypeInContext(utl_get_current_context()), 1, 0), "");
     LLVMBasicBlockRef ifBB = LLVMAppendBasicBlockInContext(utl_get_current_context(), func, "if");
     LLVMBasicBlockRef elseBB = LLVMAppendBasicBlockInContext(utl_get_current_context(), func, "else");
@@ -161,14 +162,12 @@ void ac_make_struct_destructor(AST *ast, CompilerBundle *cb)
     LLVMBuildCondBr(cb->builder, cmp, ifBB, elseBB);
     LLVMPositionBuilderAtEnd(cb->builder, ifBB);
 
-    ett->counted = 1;
-    LLVMValueRef cast = LLVMBuildBitCast(cb->builder, LLVMGetParam(func, 0), ett_llvm_type((EagleComplexType *)ett), "");
-    LLVMBuildStore(cb->builder, LLVMBuildStructGEP(cb->builder, cast, 5, ""), pos);
+    LLVMValueRef cast = LLVMBuildBitCast(cb->builder, LLVMGetParam(func, 0), ett_llvm_type(cett), "");
+    LLVMBuildStore(cb->builder, LLVMBuildStructGEP(cb->builder, cast, ET_COUNTED_PAYLOAD, ""), pos);
     LLVMBuildBr(cb->builder, mergeBB);
 
-    ett->counted = 0;
     LLVMPositionBuilderAtEnd(cb->builder, elseBB);
-    cast = LLVMBuildBitCast(cb->builder, LLVMGetParam(func, 0), ett_llvm_type((EagleComplexType *)ett), "");
+    cast = LLVMBuildBitCast(cb->builder, LLVMGetParam(func, 0), ett_llvm_type(ett), "");
     LLVMBuildStore(cb->builder, cast, pos);
     LLVMBuildBr(cb->builder, mergeBB);
 
@@ -263,7 +262,7 @@ void ac_make_struct_definitions(AST *ast, CompilerBundle *cb)
 void ac_call_copy_constructor(CompilerBundle *cb, LLVMValueRef pos, EagleComplexType *ty)
 {
     if(ET_IS_WEAK(ty) || ET_IS_COUNTED(ty))
-        pos = LLVMBuildStructGEP(cb->builder, pos, 5, "");
+        pos = LLVMBuildStructGEP(cb->builder, pos, ET_COUNTED_PAYLOAD, "");
 
     EagleStructType *st = ty->type == ETPointer ? (EagleStructType *)((EaglePointerType *)ty)->to
                                                 : (EagleStructType *)ty;
@@ -277,7 +276,7 @@ void ac_call_copy_constructor(CompilerBundle *cb, LLVMValueRef pos, EagleComplex
 void ac_call_constructor(CompilerBundle *cb, LLVMValueRef pos, EagleComplexType *ty)
 {
     if(ET_IS_WEAK(ty) || ET_IS_COUNTED(ty))
-        pos = LLVMBuildStructGEP(cb->builder, pos, 5, "");
+        pos = LLVMBuildStructGEP(cb->builder, pos, ET_COUNTED_PAYLOAD, "");
 
     EagleStructType *st = ty->type == ETPointer ? (EagleStructType *)((EaglePointerType *)ty)->to
                                                 : (EagleStructType *)ty;
@@ -11,19 +11,25 @@
 #include "ast.h"
 #include "ast_compiler.h"
 #include "core/arraylist.h"
-#include "core/mempool.h"
+#include "core/arena.h"
+#include "core/intern.h"
+#include "core/compunit.h"
+#include "core/config.h"
 
-static Mempool ast_mempool;
-static Mempool ast_lst_mempool;
-static Mempool ast_hst_mempool;
-static int init_pool = 0;
+// Every node of a unit (and the bookkeeping for the lists and tables they
+// own) lives in one arena, which is thrown away after the unit is compiled
+static EGL_THREAD_LOCAL Arena ast_arena;
 
 void ast_free_nodes()
 {
-    pool_drain(&ast_hst_mempool);
-    pool_drain(&ast_lst_mempool);
-    pool_drain(&ast_mempool);
-    init_pool = 0;
+    arena_free(&ast_arena);
+    ast_arena = arena_create();
+}
+
+void ast_arena_stats(long *allocs, size_t *peak)
+{
+    *allocs = ast_arena.allocs;
+    *peak = ast_arena.peak;
 }
 
 void ast_free_lists(void *arr)
@@ -36,32 +42,19 @@ void ast_free_tables(void *hst)
     hst_free(hst);
 }
 
-extern int yylineno;
-extern char *yytext;
-int yyerror(const char *text)
+int yyerror(yyscan_t scanner, const char *text)
 {
+    char *yytext = cu_text(cu_from_scanner(scanner));
     const char *format = strlen(yytext) == 0 ? "%s%s" : "%s (%s)";
-    die(yylineno, format, text, yytext);
+    die(cu_lineno(), format, text, yytext);
     return -1;
 }
 
 void *ast_malloc(size_t size)
 {
-    AST *ast = malloc(size);
+    AST *ast = arena_alloc(&ast_arena, size);
     ast->next = NULL;
-    ast->lineno = yylineno;
-
-    if(!init_pool)
-    {
-        ast_mempool = pool_create();
-        ast_lst_mempool = pool_create();
-        ast_lst_mempool.free_func = ast_free_lists;
-        ast_hst_mempool = pool_create();
-        ast_hst_mempool.free_func = ast_free_tables;
-        init_pool = 1;
-    }
-
-    pool_add(&ast_mempool, ast);
+    ast->lineno = cu_lineno();
 
     return ast;
 }
@@ -116,7 +109,7 @@ AST *ast_make_allocater(char op, AST *val, AST *init)
     if(at->etype->type == ETClass)
     {
         if(!init)
-            die(yylineno, "Missing parentheses after new declaration.");
+            die(cu_lineno(), "Missing parentheses after new declaration.");
         if((uintptr_t)init == 1)
             init = NULL; // We just use 1 to indicate that there is indeed parentheses, for consistency.
     }
@@ -180,10 +173,9 @@ AST *ast_make_cstr(char *text)
     ast->type = AVALUE;
     ast->etype = ETCString;
 
-    text += 1;
-    text[strlen(text) - 1] = '\0';
-    ast->value.id = text;
-    // ast->value.id = strdup(text);
+    // Tokens are interned, so the quotes are dropped by interning the
+    // inner text rather than by writing over the token
+    ast->value.id = in_intern_len(text + 1, strlen(text) - 2);
 
     return (AST *)ast;
 }
@@ -209,7 +201,7 @@ AST *ast_set_vararg(AST *ast)
 AST *ast_make_class_special_decl(char *ident, AST *body, AST *params)
 {
     if(strcmp(ident, "init") && strcmp(ident, "destruct"))
-        die(yylineno, "Unexpected identifier: %s", ident);
+        die(cu_lineno(), "Unexpected identifier: %s", ident);
 
     ASTFuncDecl *ast = ast_malloc(sizeof(ASTFuncDecl));
     ast->type = AFUNCDECL;
@@ -228,7 +220,7 @@ AST *ast_make_func_decl(AST *type, char *ident, AST *body, AST *params)
     ast->type = AFUNCDECL;
     ast->retType = type;
     ast->body = body;
-    ast->ident = ident ? ident : (char *)"close";
+    ast->ident = ident ? ident : in_intern("close");
     ast->params = params;
     ast->vararg = 0;
     ast->linkage = VLLocal;
@@ -242,7 +234,7 @@ AST *ast_make_gen_decl(AST *type, char *ident, AST *body, AST *params)
     ast->type = AGENDECL;
     ast->retType = type;
     ast->body = body;
-    ast->ident = ident ? ident : (char *)"close";
+    ast->ident = ident ? ident : in_intern("close");
     ast->params = params;
 
     return (AST *)ast;
@@ -287,8 +279,8 @@ AST *ast_make_struct_decl()
     ast->types = arr_create(10);
     ast->ext = 0;
 
-    pool_add(&ast_lst_mempool, &ast->names);
-    pool_add(&ast_lst_mempool, &ast->types);
+    arena_defer(&ast_arena, ast_free_lists, &ast->names);
+    arena_defer(&ast_arena, ast_free_lists, &ast->types);
 
     return (AST *)ast;
 }
@@ -320,8 +312,9 @@ void ast_struct_set_extern(AST *ast)
 
 AST *ast_make_struct_lit_dict()
 {
-    Hashtable *hst = malloc(sizeof(*hst));
+    Hashtable *hst = arena_alloc(&ast_arena, sizeof(*hst));
     *hst = hst_create();
+    arena_defer(&ast_arena, ast_free_tables, hst);
 
     // Pretend this is a tree node even though it is not
     return (AST *)hst;
@@ -367,11 +360,11 @@ AST *ast_make_class_decl()
     ast->interfaces = arr_create(5);
     ast->destructdecl = NULL;
 
-    pool_add(&ast_lst_mempool, &ast->names);
-    pool_add(&ast_lst_mempool, &ast->types);
-    pool_add(&ast_lst_mempool, &ast->interfaces);
-    // pool_add(&ast_hst_mempool, &ast->methods);
-    pool_add(&ast_hst_mempool, &ast->method_types);
+    arena_defer(&ast_arena, ast_free_lists, &ast->names);
+    arena_defer(&ast_arena, ast_free_lists, &ast->types);
+    arena_defer(&ast_arena, ast_free_lists, &ast->interfaces);
+    // arena_defer(&ast_arena, ast_free_tables, &ast->methods);
+    arena_defer(&ast_arena, ast_free_tables, &ast->method_types);
 
     ast->ext = 0;
 
@@ -408,7 +401,7 @@ AST *ast_class_set_init(AST *ast, AST *init)
     ASTClassDecl *cls = (ASTClassDecl *)ast;
     ASTFuncDecl *f = (ASTFuncDecl *)init;
 
-    AST *impl = ast_make_var_decl(ast_make_pointer(ast_make_type((char *)"any")), (char *)"self");
+    AST *impl = ast_make_var_decl(ast_make_pointer(ast_make_type((char *)"any")), in_intern("self"));
     impl->next = f->params;
     f->params = impl;
 
@@ -420,8 +413,9 @@ AST *ast_class_set_init(AST *ast, AST *init)
         arr_append(&list, t->etype);
     }
 
-    EagleComplexType *ttype = ett_function_type(((ASTTypeDecl *)f->retType)->etype, (EagleComplexType **)list.items, list.count);
-    ((EagleFunctionType *)ttype)->closure = 0;
+    // The self parameter is swapped out while the class is compiled, so
+    // the type must be private
+    EagleComplexType *ttype = ett_copy(ett_function_type(((ASTTypeDecl *)f->retType)->etype, (EagleComplexType **)list.items, list.count));
 
     arr_free(&list);
     if(strcmp(f->ident, "init") == 0)
@@ -432,7 +426,7 @@ AST *ast_class_set_init(AST *ast, AST *init)
     else
     {
         if(((EagleFunctionType *)ttype)->pct > 1)
-            die(yylineno, "Custom destructors can't accept parameters");
+            die(cu_lineno(), "Custom destructors can't accept parameters");
         cls->destructtype = ttype;
         cls->destructdecl = init;
     }
@@ -457,7 +451,7 @@ AST *ast_class_method_add(AST *ast, AST *func)
     ASTClassDecl *a = (ASTClassDecl *)ast;
     ASTFuncDecl *f = (ASTFuncDecl *)func;
 
-    AST *impl = ast_make_var_decl(ast_make_pointer(ast_make_type((char *)"any")), (char *)"self");
+    AST *impl = ast_make_var_decl(ast_make_pointer(ast_make_type((char *)"any")), in_intern("self"));
     impl->next = f->params;
     f->params = impl;
 
@@ -469,8 +463,9 @@ AST *ast_class_method_add(AST *ast, AST *func)
         arr_append(&list, t->etype);
     }
 
-    EagleComplexType *ttype = ett_function_type(((ASTTypeDecl *)f->retType)->etype, (EagleComplexType **)list.items, list.count);
-    ((EagleFunctionType *)ttype)->closure = 0;
+    // The self parameter is swapped out while the class is compiled, so
+    // the type must be private
+    EagleComplexType *ttype = ett_copy(ett_function_type(((ASTTypeDecl *)f->retType)->etype, (EagleComplexType **)list.items, list.count));
     arr_free(&list);
 
     // arr_append(&a->types, ett_pointer_type(ttype));
@@ -506,9 +501,9 @@ void ast_set_counted(AST *ast)
     ASTVarDecl *a = (ASTVarDecl *)ast;
     ASTTypeDecl *td = (ASTTypeDecl *)a->atype;
     if(td->etype->type != ETPointer)
-        die(yylineno, "Only pointer types can be counted.");
+        die(cu_lineno(), "Only pointer types can be counted.");
     EaglePointerType *pt = (EaglePointerType *)td->etype;
-    pt->counted = 1;
+    td->etype = ett_pointer_type_ex(pt->to, 1, pt->weak, pt->closed);
 }
 
 AST *ast_make_arr_decl(AST *atype, char *ident, AST *expr)
@@ -569,8 +564,7 @@ AST *ast_make_closure_type(AST *tysList, AST *resType)
         arr_append(&list, t->etype);
     }
 
-    ast->etype = ett_function_type(((ASTTypeDecl *)resType)->etype, (EagleComplexType **)list.items, list.count);
-    ((EagleFunctionType *)ast->etype)->closure = CLOSURE_NO_CLOSE;
+    ast->etype = ett_function_type_ex(((ASTTypeDecl *)resType)->etype, (EagleComplexType **)list.items, list.count, CLOSURE_NO_CLOSE, 0, 0);
 
     arr_free(&list);
 
@@ -591,7 +585,6 @@ AST *ast_make_function_type(AST *tysList, AST *resType)
     }
 
     ast->etype = ett_function_type(((ASTTypeDecl *)resType)->etype, (EagleComplexType **)list.items, list.count);
-    ((EagleFunctionType *)ast->etype)->closure = 0;
 
     arr_free(&list);
 
@@ -636,7 +629,7 @@ AST *ast_make_counted(AST *ast)
     if(a->etype->type != ETPointer)
         die(a->lineno, "Only pointer types may be counted.");
     EaglePointerType *ep = (EaglePointerType *)a->etype;
-    ep->counted = 1;
+    a->etype = ett_pointer_type_ex(ep->to, 1, ep->weak, ep->closed);
 
     return ast;
 }
@@ -651,8 +644,7 @@ AST *ast_make_weak(AST *ast)
     if(!ep->counted)
         die(a->lineno, "Only counted pointers may be declared weak.");
 
-    ep->weak = 1;
-    ep->counted = 0;
+    a->etype = ett_pointer_type_ex(ep->to, 0, 1, ep->closed);
 
     return ast;
 }
@@ -669,18 +661,20 @@ AST *ast_make_composite(AST *orig, char *nw)
     return orig;
 }
 
+// Each further dimension is nested innermost, so the chain is rebuilt
+static EagleComplexType *ast_array_append(EagleComplexType *type, int ct)
+{
+    if(type->type != ETArray)
+        return ett_array_type(type, ct);
+
+    EagleArrayType *et = (EagleArrayType *)type;
+    return ett_array_type(ast_array_append(et->of, ct), et->ct);
+}
+
 AST *ast_make_array(AST *ast, int ct)
 {
     ASTTypeDecl *a = (ASTTypeDecl *)ast;
-
-    if(a->etype->type == ETArray)
-    {
-        EagleArrayType *et = (EagleArrayType *)a->etype;
-        for(; et->of->type == ETArray; et = (EagleArrayType *)et->of);
-        et->of = ett_array_type(et->of, ct);
-        return ast;
-    }
-    a->etype = ett_array_type(a->etype, ct);
+    a->etype = ast_array_append(a->etype, ct);
 
     return ast;
 }
@@ -818,8 +812,7 @@ AST *ast_make_export(char *text, int tok)
     ast->type = AEXPORT;
     ast->kind = tok;
 
-    ast->fmt = text + 1;
-    text[strlen(text) - 1] = '\0';
+    ast->fmt = in_intern_len(text + 1, strlen(text) - 2);
 
     return (AST *)ast;
 }
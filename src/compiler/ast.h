@@ -397,5 +397,6 @@ AST *ast_set_external_linkage(AST *ast);
 void ast_add_if(AST *ast, AST *next);
 
 void ast_free_nodes();
+void ast_arena_stats(long *allocs, size_t *peak);
 
 #endif /* defined(__Eagle__ast__) */
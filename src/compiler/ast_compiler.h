@@ -43,6 +43,7 @@ typedef struct {
     VarScope *currentFunctionScope;
     VarScope *currentLoopScope;
     VarScope *currentCaseScope;
+    AST *currentStatement;
 
     VarScopeStack *varScope;
     Hashtable transients;
@@ -56,6 +57,10 @@ typedef struct {
 
     Hashtable genericFunctions;
     Arraylist genericWorkList;
+
+    Hashtable generatorFrames;
+    Hashtable functionDecls;
+    Hashtable classDecls;
 } CompilerBundle;
 
 #include "ac_control_flow.h"
@@ -70,5 +75,6 @@ typedef struct {
 #include "ac_enum.h"
 #include "ac_constants.h"
 #include "ac_generics.h"
+#include "ac_escape.h"
 
 #endif
@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include "variable_manager.h"
 #include "core/config.h"
+#include "core/intern.h"
 
 #define SCOPE 1
 #define BARRIER 2
@@ -44,7 +45,6 @@ void vs_push(VarScopeStack *vs)
 {
     VarScope *scope = malloc(sizeof(VarScope));
     scope->table = hst_create();
-    scope->table.duplicate_keys = 1;
     scope->scope = SCOPE;
 
     scope->next = vs->scope;
@@ -85,6 +85,9 @@ void vs_pop(VarScopeStack *vs)
     free(s);
 }
 
+// Scope tables are keyed by interned identifiers and compare them by
+// pointer, so every ident passed in here must already be interned. Names
+// from the lexer are; callers with literals intern them themselves
 VarBundle *vs_get(VarScopeStack *vs, char *ident)
 {
     VarScope *s = vs->scope;
@@ -109,7 +112,7 @@ VarBundle *vs_get(VarScopeStack *vs, char *ident)
             return NULL;
         }
 
-        VarBundle *o = hst_get(&s->table, ident, NULL, NULL);
+        VarBundle *o = hst_get(&s->table, ident, in_hash, in_equ);
         if(o)
             return o;
     }
@@ -125,7 +128,7 @@ int vs_is_in_local_scope(VarScopeStack *vs, char *ident)
     if(s->scope == BARRIER)
         return 0;
 
-    return !!(int)(uintptr_t)hst_get(&s->table, ident, NULL, NULL);
+    return !!(int)(uintptr_t)hst_get(&s->table, ident, in_hash, in_equ);
 }
 
 VarBundle *vs_get_from_module(VarScopeStack *vs, char *ident, char *mod_name)
@@ -134,7 +137,7 @@ VarBundle *vs_get_from_module(VarScopeStack *vs, char *ident, char *mod_name)
     if(!module)
         return NULL;
 
-    return hst_get(module, ident, NULL, NULL);
+    return hst_get(module, ident, in_hash, in_equ);
 }
 
 void vs_push_closure(VarScopeStack *vs, ClosedCallback cb, void *data)
@@ -156,6 +159,7 @@ static VarBundle *vs_create(char *ident, char *module, EagleComplexType *type, L
     vb->value = val;
     vb->scopeCallback = NULL;
     vb->scopeData = NULL;
+    vb->concrete = NULL;
     vb->wasused = vb->wasassigned = 0;
     vb->lineno = lineno;
     vb->module = module;
@@ -168,7 +172,7 @@ VarBundle *vs_put(VarScopeStack *vs, char *ident, LLVMValueRef val, EagleComplex
     VarBundle *vb = vs_create(ident, NULL, type, val, lineno);
     VarScope *s = vs->scope;
 
-    hst_put(&s->table, ident, vb, NULL, NULL);
+    hst_put(&s->table, ident, vb, in_hash, in_equ);
     pool_add(&vs->pool, vb);
 
     return vb;
@@ -183,12 +187,11 @@ VarBundle *vs_put_in_module(VarScopeStack *vs, char *ident, char *module, LLVMVa
     {
         mod = malloc(sizeof(Hashtable));
         *mod = hst_create();
-        mod->duplicate_keys = 1;
 
         hst_put(&vs->modules, module, mod, NULL, NULL);
     }
 
-    hst_put(mod, ident, vb, NULL, NULL);
+    hst_put(mod, ident, vb, in_hash, in_equ);
     pool_add(&vs->pool, vb);
     
     return vb;
@@ -197,7 +200,7 @@ VarBundle *vs_put_in_module(VarScopeStack *vs, char *ident, char *module, LLVMVa
 void vs_add_callback(VarScopeStack *vs, char *ident, LostScopeCallback callback, void *data)
 {
     VarScope *s = vs->scope;
-    VarBundle *vb = hst_get(&s->table, ident, NULL, NULL);
+    VarBundle *vb = hst_get(&s->table, ident, in_hash, in_equ);
     if(!vb)
         return;
 
@@ -24,6 +24,7 @@ typedef struct {
     EagleComplexType *type;
     LostScopeCallback scopeCallback;
     void *scopeData;
+    EagleComplexType *concrete; // The class behind an interface pointer, when known
 
     unsigned wasused : 1;
     unsigned wasassigned : 1;
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdlib.h>
+#include "arena.h"
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGN 16
+
+// Objects are bumped out of large chunks and never freed one at a time;
+// arena_free releases whole chunks. Objects that own memory of their own
+// (lists and tables that grow with realloc) register a cleanup, which is
+// itself arena allocated and run when the arena is freed.
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+};
+
+struct arena_cleanup {
+    struct arena_cleanup *next;
+    void (*func)(void *);
+    void *obj;
+};
+
+#define ARENA_HEADER ((sizeof(struct arena_chunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+Arena arena_create()
+{
+    Arena arena;
+    arena.head = NULL;
+    arena.cleanups = NULL;
+    arena.cursor = NULL;
+    arena.limit = NULL;
+    arena.allocs = 0;
+    arena.bytes = 0;
+    arena.peak = 0;
+
+    return arena;
+}
+
+static void arena_grow(Arena *arena, size_t size)
+{
+    size_t csize = ARENA_HEADER + size > ARENA_CHUNK_SIZE ? ARENA_HEADER + size : ARENA_CHUNK_SIZE;
+
+    struct arena_chunk *chunk = malloc(csize);
+    chunk->next = arena->head;
+    chunk->size = csize;
+    arena->head = chunk;
+
+    arena->cursor = (char *)chunk + ARENA_HEADER;
+    arena->limit = (char *)chunk + csize;
+
+    arena->bytes += csize;
+    if(arena->bytes > arena->peak)
+        arena->peak = arena->bytes;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if(!arena->cursor || (size_t)(arena->limit - arena->cursor) < size)
+        arena_grow(arena, size);
+
+    void *obj = arena->cursor;
+    arena->cursor += size;
+    arena->allocs++;
+
+    return obj;
+}
+
+void arena_defer(Arena *arena, void (*func)(void *), void *obj)
+{
+    struct arena_cleanup *c = arena_alloc(arena, sizeof(struct arena_cleanup));
+    c->next = arena->cleanups;
+    c->func = func;
+    c->obj = obj;
+    arena->cleanups = c;
+}
+
+// Keeps the counters so that they can be reported after the fact
+void arena_free(Arena *arena)
+{
+    struct arena_cleanup *c;
+    for(c = arena->cleanups; c; c = c->next)
+        c->func(c->obj);
+
+    struct arena_chunk *chunk = arena->head;
+    while(chunk)
+    {
+        struct arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    arena->head = NULL;
+    arena->cleanups = NULL;
+    arena->cursor = NULL;
+    arena->limit = NULL;
+    arena->bytes = 0;
+}
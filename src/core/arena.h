@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+struct arena_chunk;
+struct arena_cleanup;
+
+typedef struct {
+    struct arena_chunk *head;
+    struct arena_cleanup *cleanups;
+    char *cursor;
+    char *limit;
+
+    long allocs;    // Allocations since the arena was created
+    size_t bytes;   // Bytes currently held in chunks
+    size_t peak;    // Most bytes ever held in chunks
+} Arena;
+
+Arena arena_create();
+void *arena_alloc(Arena *arena, size_t size);
+void arena_defer(Arena *arena, void (*func)(void *), void *obj);
+void arena_free(Arena *arena);
+
+#endif
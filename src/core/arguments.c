@@ -76,6 +76,15 @@ static void rule_threads(char *arg, char *next, int *skip, void *data)
         warn(-1, "Invalid thread count");
 }
 
+static void rule_cache_dir(char *arg, char *next, int *skip, void *data)
+{
+    if(!next)
+        die(-1, "Argument expects operand but non provided (%s)", arg);
+    *skip = 1;
+    ShippingCrate *crate = data;
+    crate->cache_dir = next;
+}
+
 static void rule_verbose(char *arg, char *next, int *skip, void *data)
 {
     ShippingCrate *crate = data;
@@ -104,6 +113,23 @@ static void rule_seive(char *arg, char *next, int *skip, void *data)
         return;
     }
 
+    if(strncmp(arg, "--trace=", 8) == 0)
+    {
+        crate->trace_file = arg + 8;
+        return;
+    }
+
+    if(strncmp(arg, "--codegen-units=", 16) == 0)
+    {
+        crate->codegen_units = atoi(arg + 16);
+        if(crate->codegen_units < 1)
+        {
+            warn(-1, "Invalid codegen unit count");
+            crate->codegen_units = 1;
+        }
+        return;
+    }
+
     if(access(arg, R_OK) < 0)
     {
         warn(-1, "Ignoring unknown parameter (%s)", arg);
@@ -123,10 +149,21 @@ void args_setup(ShippingCrate *crate)
     ta_rule(targs, "--version", "--version", &rule_version, "Display version number and copyright information");
     ta_rule(targs, "--llvm", "--llvm", &rule_ignore, "Dump LLVM IR code to stderr");
     ta_rule(targs, "--no-rc", "--no-rc", &rule_ignore, "Do not include reference counting symbols in module");
+    ta_rule(targs, "--rc=local", "--rc=<local|atomic>", &rule_ignore, "Count references with plain (default) or thread-safe atomic operations");
+    ta_rule(targs, "--rc=atomic", NULL, &rule_ignore, NULL);
+    ta_rule(targs, "--alloc=libc", "--alloc=<libc|pool>", &rule_ignore, "Allocate counted objects with malloc (default) or from size-class pools");
+    ta_rule(targs, "--alloc=pool", NULL, &rule_ignore, NULL);
     ta_rule(targs, "--verbose", "--verbose", &rule_verbose, "Display verbose output during compilation");
     ta_rule(targs, "--code", "--code <eagle code>", &rule_code, "Provide extra code to compile");
-    ta_rule(targs, "--threads", "--threads <count>", &rule_threads, "Optimize and compile on <count> threads (default 4)");
+    ta_rule(targs, "--threads", "--threads <count>", &rule_threads, "Parse, optimize and compile on <count> threads (default: one per available core)");
+    ta_rule(targs, "--lto", "--lto", &rule_ignore, "Link all modules, the runtime included, and optimize them as one program");
+    ta_extra(targs, "--codegen-units=<count>", "Split large modules into <count> parts that are optimized and compiled in parallel (with --lto, default: one per thread)");
+    ta_rule(targs, "--cache", "--cache", &rule_ignore, "Reuse objects and import interfaces of unchanged modules from ~/.cache/eagle");
+    ta_rule(targs, "--cache-dir", "--cache-dir <dir>", &rule_cache_dir, "Reuse objects and import interfaces of unchanged modules from <dir>");
+    ta_rule(targs, "--time-report", "--time-report", &rule_ignore, "Print the time spent in each build phase, per file");
+    ta_extra(targs, "--trace=<file>", "Write a Chrome trace of the build phases and threads to <file>");
     ta_rule(targs, "--dump-code", "--dump-code", &rule_ignore, "Dump the pre-processed code from imports");
+    ta_rule(targs, "--external-as", "--external-as", &rule_ignore, "Assemble through the system compiler instead of emitting objects directly");
     ta_rule(targs, "-o", "-o <filename>", &rule_skip, "Output executable name");
     ta_rule(targs, "-c", "-c", &rule_ignore, "Output object file");
     ta_rule(targs, "-S", "-S", &rule_ignore, "Output assembly file");
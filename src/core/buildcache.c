@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "buildcache.h"
+#include "hashtable.h"
+#include "shipping.h"
+#include "threading.h"
+#include "versioning.h"
+#include "config.h"
+#include "llvm_headers.h"
+
+#define FNV_HI 0x6c62272e07bb0142ULL
+#define FNV_LO 0x62b821756295c58dULL
+#define FNV_PRIME_LOW 0x13b
+#define FNV_PRIME_SHIFT 24
+#define CHUNK 4096
+
+extern Hashtable global_args;
+
+// Every switch that changes the machine code generated for a module has to
+// be part of its key
+static const char *codegen_args[] = {
+    "-O0", "-O1", "-O2", "-O3", "--rc=atomic", "--alloc=pool", NULL
+};
+
+void bc_hash_init(BCHash *h)
+{
+    h->hi = FNV_HI;
+    h->lo = FNV_LO;
+}
+
+// Multiply by the 128-bit FNV prime, 2^88 + 0x13b, in two 64-bit halves
+static void bc_hash_mix(BCHash *h)
+{
+    uint64_t a = h->lo & 0xffffffff;
+    uint64_t b = h->lo >> 32;
+    uint64_t pa = a * FNV_PRIME_LOW;
+    uint64_t pb = b * FNV_PRIME_LOW;
+    uint64_t mid = (pa >> 32) + (pb & 0xffffffff);
+
+    uint64_t lo = (mid << 32) | (pa & 0xffffffff);
+    uint64_t carry = (pb >> 32) + (mid >> 32);
+
+    h->hi = h->hi * FNV_PRIME_LOW + carry + (h->lo << FNV_PRIME_SHIFT);
+    h->lo = lo;
+}
+
+void bc_hash_update(BCHash *h, const void *data, size_t len)
+{
+    const unsigned char *bytes = data;
+    for(size_t i = 0; i < len; i++)
+    {
+        h->lo ^= bytes[i];
+        bc_hash_mix(h);
+    }
+}
+
+void bc_hash_str(BCHash *h, const char *str)
+{
+    // Include the terminator so that ("ab", "c") and ("a", "bc") differ
+    bc_hash_update(h, str, strlen(str) + 1);
+}
+
+void bc_hash_hex(BCHash *h, char *out)
+{
+    sprintf(out, "%016llx%016llx", (unsigned long long)h->hi, (unsigned long long)h->lo);
+}
+
+char *bc_default_dir()
+{
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *suffix = "/eagle";
+
+    if(!base || !*base)
+    {
+        base = getenv("HOME");
+        suffix = "/.cache/eagle";
+    }
+
+    if(!base)
+        return NULL;
+
+    char *dir = malloc(strlen(base) + strlen(suffix) + 1);
+    sprintf(dir, "%s%s", base, suffix);
+
+    return dir;
+}
+
+void bc_prepare_dir(const char *dir)
+{
+    char *path = strdup(dir);
+    for(char *c = path + 1; ; c++)
+    {
+        if(*c != '/' && *c)
+            continue;
+
+        char save = *c;
+        *c = '\0';
+        if(mkdir(path, 0755) < 0 && errno != EEXIST)
+            die(-1, "Could not create cache directory %s", path);
+        *c = save;
+
+        if(!save)
+            break;
+    }
+
+    free(path);
+}
+
+void bc_module_key(Multibuffer *buf, int include_rc, char *out)
+{
+    BCHash h;
+    bc_hash_init(&h);
+
+    bc_hash_str(&h, ver_build_id());
+
+    char *triple = LLVMGetDefaultTargetTriple();
+    bc_hash_str(&h, triple);
+    LLVMDisposeMessage(triple);
+
+    for(const char **arg = codegen_args; *arg; arg++)
+        if(IN(global_args, *arg))
+            bc_hash_str(&h, *arg);
+    bc_hash_update(&h, &include_rc, sizeof(include_rc));
+
+    // The buffer holds the export-filtered declarations of every import
+    // followed by the source itself
+    char chunk[CHUNK];
+    int read;
+    while((read = mb_buffer(buf, chunk, CHUNK)) > 0)
+        bc_hash_update(&h, chunk, read);
+    mb_rewind(buf);
+
+    bc_hash_hex(&h, out);
+}
+
+static char *bc_entry_path(const char *dir, const char *key)
+{
+    char *path = malloc(strlen(dir) + strlen(key) + 4);
+    sprintf(path, "%s/%s.o", dir, key);
+
+    return path;
+}
+
+char *bc_lookup(const char *dir, const char *key)
+{
+    char *path = bc_entry_path(dir, key);
+    if(access(path, R_OK) == 0)
+        return path;
+
+    free(path);
+    return NULL;
+}
+
+void bc_copy_file(const char *from, const char *to)
+{
+    FILE *in = fopen(from, "rb");
+    FILE *out = fopen(to, "wb");
+    if(!in || !out)
+        die(-1, "Could not copy %s to %s", from, to);
+
+    char chunk[CHUNK];
+    size_t read;
+    while((read = fread(chunk, 1, CHUNK, in)) > 0)
+        fwrite(chunk, 1, read, out);
+
+    fclose(in);
+    fclose(out);
+}
+
+void bc_store(const char *dir, const char *key, const char *object)
+{
+    char *path = bc_entry_path(dir, key);
+
+    // Copy next to the entry and rename so that concurrent builds sharing a
+    // cache never see a partially written object
+    char *temp = malloc(strlen(path) + 50);
+    sprintf(temp, "%s.%ld.%d.tmp", path, (long)getpid(), thr_request_number());
+
+    bc_copy_file(object, temp);
+    if(rename(temp, path) < 0)
+        unlink(temp);
+
+    free(temp);
+    free(path);
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef BUILDCACHE_H
+#define BUILDCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "multibuffer.h"
+
+#define BC_KEY_LEN 32
+
+// 128-bit FNV-1a
+typedef struct {
+    uint64_t hi;
+    uint64_t lo;
+} BCHash;
+
+void bc_hash_init(BCHash *h);
+void bc_hash_update(BCHash *h, const void *data, size_t len);
+void bc_hash_str(BCHash *h, const char *str);
+void bc_hash_hex(BCHash *h, char *out);
+
+char *bc_default_dir();
+void bc_prepare_dir(const char *dir);
+void bc_module_key(Multibuffer *buf, int include_rc, char *out);
+char *bc_lookup(const char *dir, const char *key);
+void bc_store(const char *dir, const char *key, const char *object);
+void bc_copy_file(const char *from, const char *to);
+
+#endif
@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "compunit.h"
+#include "config.h"
+#include "intern.h"
+#include "compiler/ast.h"
+#include "grammar/eagle.tab.h"
+
+#define YY_BUF_SIZE 32768
+#define CU_MAX_TEXT 65536
+
+typedef struct yy_buffer_state *YY_BUFFER_STATE;
+
+extern int yylex_init_extra(CompilationUnit *extra, yyscan_t *scanner);
+extern int yylex_destroy(yyscan_t scanner);
+extern CompilationUnit *yyget_extra(yyscan_t scanner);
+extern char *yyget_text(yyscan_t scanner);
+extern int yyget_lineno(yyscan_t scanner);
+extern int yyget_leng(yyscan_t scanner);
+extern YY_BUFFER_STATE yy_create_buffer(FILE *file, int size, yyscan_t scanner);
+extern void yy_switch_to_buffer(YY_BUFFER_STATE buf, yyscan_t scanner);
+extern int yylex(YYSTYPE *lval, yyscan_t scanner);
+
+typedef struct CUToken {
+    int token;
+    int lineno;
+    char *text;
+    YYSTYPE value;
+} CUToken;
+
+static EGL_THREAD_LOCAL CompilationUnit *current_unit = NULL;
+
+CompilationUnit *cu_create(CompilationUnitKind kind, char *filename)
+{
+    CompilationUnit *unit = calloc(1, sizeof(CompilationUnit));
+    unit->kind = kind;
+    unit->filename = filename;
+
+    unit->type_names = hst_create();
+    unit->type_names.duplicate_keys = 1;
+
+    return unit;
+}
+
+void cu_free(CompilationUnit *unit)
+{
+    if(unit->scanner)
+        cu_close_scanner(unit);
+    if(unit->buffer)
+        mb_free(unit->buffer);
+
+    hst_free(&unit->type_names);
+    cu_free_tokens(unit);
+    free(unit->cache_key);
+    free(unit);
+}
+
+void cu_set_current(CompilationUnit *unit)
+{
+    current_unit = unit;
+}
+
+CompilationUnit *cu_current()
+{
+    return current_unit;
+}
+
+CompilationUnit *cu_from_scanner(yyscan_t scanner)
+{
+    return yyget_extra(scanner);
+}
+
+void cu_open_scanner(CompilationUnit *unit, FILE *in)
+{
+    yylex_init_extra(unit, &unit->scanner);
+
+    YY_BUFFER_STATE buf = yy_create_buffer(in, YY_BUF_SIZE, unit->scanner);
+    yy_switch_to_buffer(buf, unit->scanner);
+}
+
+void cu_close_scanner(CompilationUnit *unit)
+{
+    // Once tokenized, the line number follows the replayed tokens
+    if(!unit->tokens)
+        unit->lineno = yyget_lineno(unit->scanner);
+    yylex_destroy(unit->scanner);
+    unit->scanner = NULL;
+}
+
+static CUToken *cu_push(CompilationUnit *unit)
+{
+    if(unit->token_count == unit->token_alloc)
+    {
+        unit->token_alloc = unit->token_alloc ? unit->token_alloc * 2 : 1024;
+        unit->tokens = realloc(unit->tokens, unit->token_alloc * sizeof(CUToken));
+    }
+
+    return unit->tokens + unit->token_count++;
+}
+
+// Lexes the whole input of the open scanner. Identifiers all come out as
+// TIDENTIFIER; telling type names apart is left to the parser, since they
+// are only known once the prepass has seen every declaration
+void cu_tokenize(CompilationUnit *unit)
+{
+    cu_free_tokens(unit);
+    unit->save_newline = unit->override = unit->in_interface = unit->seen_eof = 0;
+
+    YYSTYPE lval;
+    int token;
+    while((token = yylex(&lval, unit->scanner)) != 0)
+    {
+        CUToken *t = cu_push(unit);
+        t->token = token;
+        t->lineno = yyget_lineno(unit->scanner);
+        t->text = in_intern_len(yyget_text(unit->scanner), yyget_leng(unit->scanner));
+        t->value = lval;
+    }
+
+    cu_rewind(unit);
+}
+
+// Puts the tokens of from in front of those of the unit. The end of input
+// marker of from is dropped, so the stream reads as if both had been
+// lexed from one buffer
+void cu_prepend(CompilationUnit *unit, CompilationUnit *from)
+{
+    int count = from->token_count - 1;
+    if(count > 0)
+    {
+        if(unit->token_count + count > unit->token_alloc)
+        {
+            unit->token_alloc = unit->token_count + count;
+            unit->tokens = realloc(unit->tokens, unit->token_alloc * sizeof(CUToken));
+        }
+
+        memmove(unit->tokens + count, unit->tokens, unit->token_count * sizeof(CUToken));
+        memcpy(unit->tokens, from->tokens, count * sizeof(CUToken));
+        unit->token_count += count;
+    }
+
+    cu_rewind(unit);
+}
+
+// Only tokens the lexer saves the text of carry a string
+static int cu_has_string(int token)
+{
+    switch(token)
+    {
+        case TIDENTIFIER:
+        case TINT:
+        case TDOUBLE:
+        case TCHARLIT:
+        case TTYPE:
+        case TIMPORT:
+        case TCSTR:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static void cu_write_str(FILE *f, const char *str)
+{
+    int len = strlen(str);
+    fwrite(&len, sizeof(int), 1, f);
+    fwrite(str, 1, len, f);
+}
+
+static char *cu_read_str(FILE *f)
+{
+    int len;
+    if(fread(&len, sizeof(int), 1, f) != 1 || len < 0 || len > CU_MAX_TEXT)
+        return NULL;
+
+    char buf[len + 1];
+    if(fread(buf, 1, len, f) != (size_t)len)
+        return NULL;
+
+    return in_intern_len(buf, len);
+}
+
+void cu_write_tokens(CompilationUnit *unit, FILE *f)
+{
+    fwrite(&unit->token_count, sizeof(int), 1, f);
+
+    int i;
+    for(i = 0; i < unit->token_count; i++)
+    {
+        CUToken *t = unit->tokens + i;
+        fwrite(&t->token, sizeof(int), 1, f);
+        fwrite(&t->lineno, sizeof(int), 1, f);
+        cu_write_str(f, t->text);
+
+        // String literals hold their escaped text
+        if(t->token == TCSTR)
+            cu_write_str(f, t->value.string);
+    }
+}
+
+// Returns 0 if the file is cut short
+int cu_read_tokens(CompilationUnit *unit, FILE *f)
+{
+    cu_free_tokens(unit);
+
+    int count;
+    if(fread(&count, sizeof(int), 1, f) != 1)
+        return 0;
+
+    int i;
+    for(i = 0; i < count; i++)
+    {
+        CUToken *t = cu_push(unit);
+        if(fread(&t->token, sizeof(int), 1, f) != 1 ||
+           fread(&t->lineno, sizeof(int), 1, f) != 1 ||
+           !(t->text = cu_read_str(f)))
+            return 0;
+
+        if(t->token == TCSTR)
+        {
+            if(!(t->value.string = cu_read_str(f)))
+                return 0;
+        }
+        else if(cu_has_string(t->token))
+            t->value.string = t->text;
+        else
+            t->value.token = t->token;
+    }
+
+    cu_rewind(unit);
+    return 1;
+}
+
+void cu_rewind(CompilationUnit *unit)
+{
+    unit->token_pos = 0;
+    unit->token_text = (char *)"";
+    unit->lineno = 0;
+}
+
+void cu_free_tokens(CompilationUnit *unit)
+{
+    free(unit->tokens);
+    unit->tokens = NULL;
+    unit->token_count = unit->token_alloc = 0;
+}
+
+int cu_next(CompilationUnit *unit, YYSTYPE *lval)
+{
+    if(unit->start_token)
+    {
+        int temp = unit->start_token;
+        unit->start_token = 0;
+        return temp;
+    }
+
+    if(unit->token_pos >= unit->token_count)
+    {
+        unit->token_text = (char *)"";
+        return 0;
+    }
+
+    CUToken *t = unit->tokens + unit->token_pos++;
+    unit->lineno = t->lineno;
+    unit->token_text = t->text;
+    if(lval)
+        *lval = t->value;
+
+    return t->token;
+}
+
+int cu_lex(CompilationUnit *unit)
+{
+    if(unit->tokens)
+        return cu_next(unit, NULL);
+
+    YYSTYPE lval;
+    return yylex(&lval, unit->scanner);
+}
+
+char *cu_text(CompilationUnit *unit)
+{
+    if(unit->tokens)
+        return unit->token_text;
+
+    return yyget_text(unit->scanner);
+}
+
+int cu_get_lineno(CompilationUnit *unit)
+{
+    if(!unit)
+        return -1;
+    if(!unit->scanner || unit->tokens)
+        return unit->lineno;
+
+    return yyget_lineno(unit->scanner);
+}
+
+int cu_lineno()
+{
+    return cu_get_lineno(current_unit);
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef COMPUNIT_H
+#define COMPUNIT_H
+
+#include <stdio.h>
+#include "llvm_headers.h"
+#include "hashtable.h"
+#include "multibuffer.h"
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+#define CU_LOOKBACK 3
+
+struct AST;
+struct CUToken;
+union YYSTYPE;
+
+typedef enum {
+    CUFile,
+    CUString,
+    CURuntime
+} CompilationUnitKind;
+
+// Everything the front end needs to turn one source into one module. A
+// unit is only ever worked on by a single thread, so nothing in here is
+// locked.
+typedef struct CompilationUnit {
+    CompilationUnitKind kind;
+    char *filename;
+    const char *code;
+    int include_rc;
+
+    Multibuffer *buffer;
+    yyscan_t scanner;
+    int lineno;
+    struct AST *ast_root;
+
+    LLVMContextRef context;
+    LLVMModuleRef module;
+
+    char *cache_key;
+    char *cached_object;
+
+    // Lexer state
+    int start_token;
+    int save_newline;
+    int override;
+    int in_interface;
+    int read_file;
+    int seen_eof;
+
+    // The token stream, lexed once by cu_tokenize and then replayed to the
+    // type name prepass, the import scanner and the parser
+    struct CUToken *tokens;
+    int token_count;
+    int token_alloc;
+    int token_pos;
+    char *token_text;
+
+    // Generic type name pipeline state
+    int in_type_context;
+    int previous_tokens[CU_LOOKBACK];
+    Hashtable type_names;
+} CompilationUnit;
+
+CompilationUnit *cu_create(CompilationUnitKind kind, char *filename);
+void cu_free(CompilationUnit *unit);
+
+void cu_set_current(CompilationUnit *unit);
+CompilationUnit *cu_current();
+CompilationUnit *cu_from_scanner(yyscan_t scanner);
+
+void cu_open_scanner(CompilationUnit *unit, FILE *in);
+void cu_close_scanner(CompilationUnit *unit);
+void cu_tokenize(CompilationUnit *unit);
+void cu_prepend(CompilationUnit *unit, CompilationUnit *from);
+void cu_write_tokens(CompilationUnit *unit, FILE *f);
+int cu_read_tokens(CompilationUnit *unit, FILE *f);
+void cu_rewind(CompilationUnit *unit);
+void cu_free_tokens(CompilationUnit *unit);
+int cu_next(CompilationUnit *unit, union YYSTYPE *lval);
+int cu_lex(CompilationUnit *unit);
+char *cu_text(CompilationUnit *unit);
+int cu_get_lineno(CompilationUnit *unit);
+int cu_lineno();
+
+#endif
@@ -12,13 +12,20 @@
 
 // If we have an equals function, use it; otherwise use pointer equality
 #define EQU_CHECK(a, b, f) (f ? (f(a, b)) : (!strcmp(a, b)))
-#define NO_RESIZE
+
+// Open addressing with robin hood probing. Every slot remembers the full
+// hash of its key and how far it sits from its home bucket; a distance of
+// zero marks an empty slot. Lookups stop as soon as they reach a slot that
+// is closer to home than the probe, so misses stay short even when full.
+#define INITIAL_SIZE 8
+#define MAX_LOAD(size) ((size) - ((size) >> 2))
+#define MASK(ht) ((unsigned long)(ht)->size - 1)
 
 struct HSTNode_s {
-    long hash;
+    unsigned long hash;
     void *key;
     void *val;
-    struct HSTNode_s *next;
+    unsigned long dist;
 };
 
 long hst_djb2(void *val, void *data)
@@ -33,119 +40,125 @@ long hst_djb2(void *val, void *data)
     return hash;
 }
 
+// Buckets are picked from the low bits, so spread out weak hashes (like
+// the aligned pointers used by identity tables) before masking
+static unsigned long hst_mix(long hash)
+{
+    unsigned long h = (unsigned long)hash;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdUL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+static unsigned long hst_hash(void *key, hst_hash_function hashfunc)
+{
+    return hst_mix(hashfunc ? hashfunc(key, NULL) : hst_djb2(key, NULL));
+}
+
 Hashtable hst_create()
 {
-    HSTNode **buckets = calloc(8, sizeof(HSTNode *));
+    HSTNode *buckets = calloc(INITIAL_SIZE, sizeof(HSTNode));
 
-    Hashtable ht = {0, 8, 0, buckets};
+    Hashtable ht = {0, INITIAL_SIZE, 0, buckets};
 
     return ht;
 }
 
-HSTNode *hst_make_node(long hash, void *key, void *val, char dup)
+static char *hst_dup_key(void *key)
 {
-    HSTNode *n = malloc(sizeof(HSTNode));
+    char *k = (char *)key;
+    char *n = malloc(strlen(k) + 1);
+    strcpy(n, k);
 
-    if(dup)
-    {
-        char *k = (char *)key;
-        n->key = malloc(strlen(k) + 1);
-        strcpy(n->key, k);
-    }
-    else
-        n->key = key;
-    n->hash = hash;
-    n->val = val;
-    n->next = NULL;
     return n;
 }
 
-void hst_resize(Hashtable *ht)
+// Places an entry known not to be in the table yet
+static void hst_place(HSTNode *buckets, unsigned long mask, HSTNode entry)
 {
-    int ns = ht->size > 1000 ? ht->size + 1000 : ht->size * 2;
-    HSTNode **buckets = calloc(ns, sizeof(HSTNode *));
+    unsigned long idx = entry.hash & mask;
+    entry.dist = 1;
 
-    int i;
-    HSTNode *n;
-    HSTNode *p;
-    for(i = 0; i < ht->size; i++)
+    for(;; idx = (idx + 1) & mask, entry.dist++)
     {
-        for(n = ht->buckets[i]; n;)
+        HSTNode *slot = buckets + idx;
+        if(!slot->dist)
         {
-            p = n->next;
-            int mod = (unsigned long)n->hash % ns;
-            if(!buckets[mod])
-            {
-                buckets[mod] = n;
-                n->next = NULL;
-                n = p;
-                continue;
-            }
-
-            HSTNode *x = buckets[mod];
-            for(; x->next; x = x->next);
-            x->next = n;
-            n->next = NULL;
-
-            n = p;
+            *slot = entry;
+            return;
+        }
+
+        if(slot->dist < entry.dist)
+        {
+            HSTNode displaced = *slot;
+            *slot = entry;
+            entry = displaced;
         }
     }
+}
+
+void hst_resize(Hashtable *ht)
+{
+    int ns = ht->size * 2;
+    HSTNode *buckets = calloc(ns, sizeof(HSTNode));
+
+    int i;
+    for(i = 0; i < ht->size; i++)
+        if(ht->buckets[i].dist)
+            hst_place(buckets, (unsigned long)ns - 1, ht->buckets[i]);
 
     free(ht->buckets);
     ht->buckets = buckets;
     ht->size = ns;
 }
 
-void hst_put(Hashtable *ht, void *key, void *val, hst_hash_function hashfunc, hst_equa_function equfunc)
+static HSTNode *hst_find(Hashtable *ht, void *key, unsigned long hash, hst_equa_function equfunc)
 {
-#ifndef NO_RESIZE
-    if(ht->count + 1 > ht->size * (0.66))
-        hst_resize(ht);
-#endif
+    unsigned long mask = MASK(ht);
+    unsigned long idx = hash & mask;
+    unsigned long dist = 1;
+
+    for(;; idx = (idx + 1) & mask, dist++)
+    {
+        HSTNode *slot = ht->buckets + idx;
+        if(slot->dist < dist)
+            return NULL;
 
-    if(!hashfunc)
-        hashfunc = hst_djb2;
+        if(slot->hash == hash && EQU_CHECK(slot->key, key, equfunc))
+            return slot;
+    }
+}
 
-    long hash = hashfunc(key, NULL);
-    unsigned long mod = ((unsigned long)hash) % ht->size;
+void hst_put(Hashtable *ht, void *key, void *val, hst_hash_function hashfunc, hst_equa_function equfunc)
+{
+    unsigned long hash = hst_hash(key, hashfunc);
 
-    if(!ht->buckets[mod])
+    HSTNode *found = hst_find(ht, key, hash, equfunc);
+    if(found)
     {
-        ht->buckets[mod] = hst_make_node(hash, key, val, ht->duplicate_keys);
-        ht->count++;
+        found->val = val;
         return;
     }
 
-    HSTNode *last;
-    HSTNode *prev = NULL;
-    for(last = ht->buckets[mod]; last; last = last->next)
-    {
-        if(EQU_CHECK(last->key, key, equfunc))
-        {
-            last->val = val;
-            return;
-        }
+    if(ht->count + 1 > MAX_LOAD(ht->size))
+        hst_resize(ht);
 
-        prev = last;
-    }
+    HSTNode entry;
+    entry.hash = hash;
+    entry.key = ht->duplicate_keys ? hst_dup_key(key) : key;
+    entry.val = val;
 
+    hst_place(ht->buckets, MASK(ht), entry);
     ht->count++;
-    prev->next = hst_make_node(hash, key, val, ht->duplicate_keys);
 }
 
 void *hst_get(Hashtable *ht, void *key, hst_hash_function hashfunc, hst_equa_function equfunc)
 {
-    if(!hashfunc)
-        hashfunc = hst_djb2;
-
-    long hash = hashfunc(key, NULL);
-    long mod = (unsigned long)hash % ht->size;
-
-    HSTNode *n = ht->buckets[mod];
-
-    for(; n; n = n->next) if(EQU_CHECK(n->key, key, equfunc)) return n->val;
+    HSTNode *n = hst_find(ht, key, hst_hash(key, hashfunc), equfunc);
 
-    return NULL;
+    return n ? n->val : NULL;
 }
 
 char *hst_retrieve_duped_key(Hashtable *ht, char *key)
@@ -153,135 +166,93 @@ char *hst_retrieve_duped_key(Hashtable *ht, char *key)
     if(!ht->duplicate_keys)
         return NULL;
 
-    long hash = hst_djb2(key, NULL);
-    long mod = (unsigned long)hash % ht->size;
+    HSTNode *n = hst_find(ht, key, hst_hash(key, NULL), NULL);
 
-    HSTNode *n = ht->buckets[mod];
-
-    for(; n; n = n->next) if(!strcmp(key, n->key)) return n->key;
-
-    return NULL;
+    return n ? n->key : NULL;
 }
 
 void hst_add_all_from(Hashtable *ht, Hashtable *ot, hst_hash_function hashfunc, hst_equa_function equfunc)
 {
-    if(!hashfunc)
-        hashfunc = hst_djb2;
-
     int i;
     for(i = 0; i < ot->size; i++)
-    {
-        HSTNode *n;
-        for(n = ot->buckets[i]; n; n = n->next)
-            hst_put(ht, n->key, n->val, hashfunc, equfunc);
-    }
+        if(ot->buckets[i].dist)
+            hst_put(ht, ot->buckets[i].key, ot->buckets[i].val, hashfunc, equfunc);
 }
 
 int hst_contains_key(Hashtable *ht, void *key, hst_hash_function hashfunc, hst_equa_function equfunc)
 {
-    if(!hashfunc)
-        hashfunc = hst_djb2;
-
-    long hash = hashfunc(key, NULL);
-    long mod = (unsigned long)hash % ht->size;
-
-    HSTNode *n = ht->buckets[mod];
-
-    for(; n; n = n->next) if(EQU_CHECK(n->key, key, equfunc)) return 1;
-
-    return 0;
+    return hst_find(ht, key, hst_hash(key, hashfunc), equfunc) != NULL;
 }
 
 int hst_contains_value(Hashtable *ht, void *val, hst_equa_function equfunc)
 {
     int i;
-    HSTNode *n = NULL;
     for(i = 0; i < ht->size; i++)
-        for(n = ht->buckets[i]; n; n = n->next)
-            if(EQU_CHECK(n->val, val, equfunc))
-                return 1;
+        if(ht->buckets[i].dist && EQU_CHECK(ht->buckets[i].val, val, equfunc))
+            return 1;
 
     return 0;
 }
 
-void *hst_remove_key(Hashtable *ht, void *key, hst_hash_function hashfunc, hst_equa_function equfunc)
+// Backward shift deletion: pull every following entry that is away from
+// its home bucket one slot closer, so no tombstones are needed
+static void hst_erase(Hashtable *ht, HSTNode *slot)
 {
-    void *ret = NULL;
-
-    if(!hashfunc)
-        hashfunc = hst_djb2;
-
-    long hash = hashfunc(key, NULL);
-    long mod = (unsigned long)hash % ht->size;
+    unsigned long mask = MASK(ht);
+    unsigned long idx = slot - ht->buckets;
 
-    HSTNode *n = ht->buckets[mod];
-    HSTNode *p = NULL;
+    if(ht->duplicate_keys)
+        free(slot->key);
 
-    for(; n; n = n->next)
+    for(;;)
     {
-        if(EQU_CHECK(n->key, key, equfunc))
-        {
-            ret = n->val;
-            if(p)
-                p->next = n->next;
-            else
-                ht->buckets[mod] = n->next;
-
-            if(ht->duplicate_keys)
-                free(n->key);
-            free(n);
-            ht->count--;
+        unsigned long next = (idx + 1) & mask;
+        if(ht->buckets[next].dist <= 1)
             break;
-        }
 
-        p = n;
+        ht->buckets[idx] = ht->buckets[next];
+        ht->buckets[idx].dist--;
+        idx = next;
     }
 
+    memset(ht->buckets + idx, 0, sizeof(HSTNode));
+    ht->count--;
+}
+
+void *hst_remove_key(Hashtable *ht, void *key, hst_hash_function hashfunc, hst_equa_function equfunc)
+{
+    HSTNode *n = hst_find(ht, key, hst_hash(key, hashfunc), equfunc);
+    if(!n)
+        return NULL;
+
+    void *ret = n->val;
+    hst_erase(ht, n);
+
     return ret;
 }
 
 void hst_remove_val(Hashtable *ht, void *val, hst_equa_function equfunc)
 {
     int i;
-    HSTNode *n = NULL;
-    for(i = 0; i < ht->size; i++)
+    for(i = 0; i < ht->size;)
     {
-        HSTNode *p = NULL;
-        for(n = ht->buckets[i]; n; n = n->next)
-        {
-            if(EQU_CHECK(n->val, val, equfunc))
-            {
-                if(p)
-                    p->next = n->next;
-                else
-                    ht->buckets[i] = n->next;
-
-                if(ht->duplicate_keys)
-                    free(n->key);
-                free(n);
-                ht->count--;
-            }
-
-            p = n;
-        }
+        HSTNode *n = ht->buckets + i;
+
+        // Erasing shifts the next entry into this slot, so look again
+        if(n->dist && EQU_CHECK(n->val, val, equfunc))
+            hst_erase(ht, n);
+        else
+            i++;
     }
 }
 
 void hst_free(Hashtable *ht)
 {
     int i;
-    for(i = 0; i < ht->size; i++)
-    {
-        HSTNode *n = ht->buckets[i];
-        while(n)
-        {
-            HSTNode *next = n->next;
-            if(ht->duplicate_keys)
-                free(n->key);
-            free(n);
-            n = next;
-        }
-    }
+    if(ht->duplicate_keys)
+        for(i = 0; i < ht->size; i++)
+            if(ht->buckets[i].dist)
+                free(ht->buckets[i].key);
 
     free(ht->buckets);
 }
@@ -289,8 +260,7 @@ void hst_free(Hashtable *ht)
 void hst_for_each(Hashtable *ht, hst_each_function func, void *data)
 {
     int i;
-    HSTNode *n;
     for(i = 0; i < ht->size; i++)
-        for(n = ht->buckets[i]; n; n = n->next)
-            func(n->key, n->val, data);
+        if(ht->buckets[i].dist)
+            func(ht->buckets[i].key, ht->buckets[i].val, data);
 }
@@ -20,7 +20,7 @@ typedef struct hashtable_s {
     int count;
     int size;
     char duplicate_keys;
-    HSTNode **buckets;
+    HSTNode *buckets;
 } Hashtable;
 
 Hashtable hst_create();
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "intern.h"
+#include "arena.h"
+#include "config.h"
+
+#define INITIAL_SIZE 1024
+#define MAX_LOAD(size) ((size) - ((size) >> 2))
+
+// Each string is preceded by its header in the arena
+typedef struct {
+    unsigned long hash;
+    size_t len;
+} InternHeader;
+
+#define HEADER(str) ((InternHeader *)(str) - 1)
+
+static EGL_THREAD_LOCAL Arena in_arena;
+static EGL_THREAD_LOCAL char **in_slots = NULL;
+static EGL_THREAD_LOCAL unsigned long in_size = 0;
+static EGL_THREAD_LOCAL unsigned long in_count = 0;
+
+static unsigned long in_djb2(const char *str, size_t len)
+{
+    unsigned long hash = 5381;
+    size_t i;
+    for(i = 0; i < len; i++)
+        hash = ((hash << 5) + hash) + (unsigned char)str[i];
+
+    return hash;
+}
+
+static void in_place(char **slots, unsigned long mask, char *str)
+{
+    unsigned long idx;
+    for(idx = HEADER(str)->hash & mask; slots[idx]; idx = (idx + 1) & mask);
+    slots[idx] = str;
+}
+
+static void in_grow()
+{
+    unsigned long ns = in_size ? in_size * 2 : INITIAL_SIZE;
+    char **slots = calloc(ns, sizeof(char *));
+
+    unsigned long i;
+    for(i = 0; i < in_size; i++)
+        if(in_slots[i])
+            in_place(slots, ns - 1, in_slots[i]);
+
+    free(in_slots);
+    in_slots = slots;
+    in_size = ns;
+}
+
+char *in_intern(const char *str)
+{
+    return in_intern_len(str, strlen(str));
+}
+
+char *in_intern_len(const char *str, size_t len)
+{
+    if(!in_slots)
+        in_grow();
+
+    unsigned long hash = in_djb2(str, len);
+    unsigned long mask = in_size - 1;
+    unsigned long idx;
+    for(idx = hash & mask; in_slots[idx]; idx = (idx + 1) & mask)
+    {
+        char *cur = in_slots[idx];
+        InternHeader *h = HEADER(cur);
+        if(h->hash == hash && h->len == len && !memcmp(cur, str, len))
+            return cur;
+    }
+
+    InternHeader *h = arena_alloc(&in_arena, sizeof(InternHeader) + len + 1);
+    h->hash = hash;
+    h->len = len;
+
+    char *out = (char *)(h + 1);
+    memcpy(out, str, len);
+    out[len] = '\0';
+
+    in_slots[idx] = out;
+    if(++in_count > MAX_LOAD(in_size))
+        in_grow();
+
+    return out;
+}
+
+void in_free()
+{
+    arena_free(&in_arena);
+    free(in_slots);
+
+    in_slots = NULL;
+    in_size = 0;
+    in_count = 0;
+}
+
+long in_hash(void *key, void *data)
+{
+    return (long)HEADER(key)->hash;
+}
+
+int in_equ(void *key, void *data)
+{
+    return key == data;
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+// Interned strings are unique per thread: equal text yields the same
+// pointer, and the hash of the text is stored alongside it. They must not
+// be modified or freed, and live until in_free.
+char *in_intern(const char *str);
+char *in_intern_len(const char *str, size_t len);
+void in_free();
+
+// Hashtable callbacks for tables keyed on interned strings
+long in_hash(void *key, void *data);
+int in_equ(void *key, void *data);
+
+#endif
@@ -10,6 +10,7 @@
 #define LLVM_HEADERS_H
 
 #include <llvm-c/Transforms/PassManagerBuilder.h>
+#include <llvm-c/Transforms/IPO.h>
 #include <llvm-c/TargetMachine.h>
 #include <llvm-c/Core.h>
 
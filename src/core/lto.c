@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/Linker.h>
+#include "lto.h"
+#include "threading.h"
+#include "colors.h"
+#include "config.h"
+#include "trace.h"
+
+// Each module lives in a context of its own, so it is copied into the
+// shared one through bitcode before being linked in
+static void lto_link_module(LLVMModuleRef whole, ThreadingBundle *bundle)
+{
+    LLVMContextRef context = LLVMGetModuleContext(whole);
+    LLVMMemoryBufferRef bitcode = LLVMWriteBitcodeToMemoryBuffer(bundle->module);
+
+    LLVMModuleRef module;
+    char *error = NULL;
+    if(LLVMParseBitcodeInContext(context, bitcode, &module, &error))
+        die(-1, "Internal compiler error: could not load %s for --lto (%s)", bundle->filename, error);
+
+    LLVMDisposeMemoryBuffer(bitcode);
+
+    if(LLVMLinkModules(whole, module, LLVMLinkerDestroySource, &error))
+        die(-1, "Could not link %s for --lto (%s)", bundle->filename, error);
+
+    LLVMDisposeModule(module);
+    LLVMDisposeModule(bundle->module);
+    bundle->module = NULL;
+}
+
+// Once the whole program is in one module only main has to stay visible,
+// which lets the optimizer drop, inline and specialize everything else
+static void lto_internalize(LLVMModuleRef module)
+{
+    LLVMValueRef func;
+    for(func = LLVMGetFirstFunction(module); func; func = LLVMGetNextFunction(func))
+        if(!LLVMIsDeclaration(func) && LLVMGetLinkage(func) == LLVMExternalLinkage &&
+           strcmp(LLVMGetValueName(func), "main"))
+            LLVMSetLinkage(func, LLVMInternalLinkage);
+
+    LLVMValueRef glob;
+    for(glob = LLVMGetFirstGlobal(module); glob; glob = LLVMGetNextGlobal(glob))
+        if(!LLVMIsDeclaration(glob) && LLVMGetLinkage(glob) == LLVMExternalLinkage)
+            LLVMSetLinkage(glob, LLVMInternalLinkage);
+}
+
+void lto_link_work(ShippingCrate *crate)
+{
+    if(!crate->work.count)
+        return;
+
+    LLVMContextRef context = LLVMContextCreate();
+    LLVMModuleRef whole = LLVMModuleCreateWithNameInContext("whole-program", context);
+
+    TraceSpan link = trc_begin("lto link");
+    int elided = 0;
+
+    int i;
+    for(i = 0; i < crate->work.count; i++)
+    {
+        ThreadingBundle *bundle = crate->work.items[i];
+        elided += shp_elide(bundle->module);
+        lto_link_module(whole, bundle);
+        free(bundle);
+    }
+
+    trc_end(&link);
+
+    // Objects given on the command line may call into any of the modules
+    if(!crate->object_files.count)
+        lto_internalize(whole);
+    else if(crate->verbose)
+        printf(BLUE "Whole program" DEFAULT " -- object files given, keeping symbols visible\n");
+
+    TraceSpan opt = trc_begin("lto optimize");
+    shp_run_passes(whole);
+    trc_end(&opt);
+
+    if(crate->verbose)
+        printf(BLUE "Whole program" DEFAULT " -- linked %d modules, %d reference counting operations elided\n",
+               (int)crate->work.count, elided);
+
+    ThreadingBundle *bundle = thr_create_bundle(whole, context, (char *)"whole-program");
+    bundle->optimized = 1;
+
+    arr_clear(&crate->work);
+    arr_append(&crate->work, bundle);
+}
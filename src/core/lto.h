@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef LTO_H
+#define LTO_H
+
+#include "shipping.h"
+
+// Replaces the modules queued on the crate with one linked and optimized
+// module for --lto. Code generation splits it into codegen units again.
+void lto_link_work(ShippingCrate *crate);
+
+#endif
@@ -7,6 +7,9 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <libgen.h>
+#include <unistd.h>
 #include <sys/time.h>
 #include "compiler/ast_compiler.h"
 #include "compiler/ast.h"
@@ -21,44 +24,30 @@
 #include "threading.h"
 #include "arguments.h"
 #include "colors.h"
+#include "compunit.h"
+#include "buildcache.h"
+#include "trace.h"
+#include "lto.h"
 
-#define YY_BUF_SIZE 32768
 #define SEQU(a, b) strcmp((a), (b)) == 0
 
-extern char *yytext;
-
-extern FILE *yyin;
-extern int yyparse();
-extern void yyset_start_token(int);
-extern int yylex();
-extern int yylineno;
-
-extern AST *ast_root;
-
 Hashtable global_args;
-Multibuffer *ymultibuffer = NULL;
 
-typedef void * YY_BUFFER_STATE;
-extern YY_BUFFER_STATE yy_create_buffer(FILE*, size_t);
-extern void yy_switch_to_buffer(YY_BUFFER_STATE buf);
-extern void yy_delete_buffer(YY_BUFFER_STATE buf);
+EGL_THREAD_LOCAL char *current_file_name = NULL;
 
-char *current_file_name = NULL;
-
-static void register_typedef()
+// Token text is interned, so equal names are the same pointer
+static void register_typedef(CompilationUnit *unit)
 {
     char *prev = NULL;
     int token;
     int count = 0;
     int same = 0;
-    while((token = yylex()) != TSEMI)
+    while((token = cu_lex(unit)) != TSEMI)
     {
         count++;
 
-        same = prev && strcmp(prev, yytext) == 0;
-        if(prev)
-            free(prev);
-        prev = strdup(yytext);
+        same = prev == cu_text(unit);
+        prev = cu_text(unit);
     }
 
     if(count == 2 && same)
@@ -66,18 +55,18 @@ static void register_typedef()
 
     ty_add_name(prev);
     ty_register_typedef(prev);
-    free(prev);
 }
 
-static void first_pass()
+static void first_pass(CompilationUnit *unit)
 {
     int token;
     int saveNextStruct = 0;
     int saveNextClass = 0;
     int saveNextInterface = 0;
     int saveNextEnum = 0;
-    while((token = yylex()) != 0)
+    while((token = cu_lex(unit)) != 0)
     {
+        char *yytext = cu_text(unit);
         if(saveNextStruct)
         {
             ty_add_name(yytext);
@@ -105,14 +94,10 @@ static void first_pass()
         saveNextEnum = token == TENUM;
 
         if(token == TTYPEDEF)
-            register_typedef();
+            register_typedef(unit);
     }
 
-    //rewind(yyin);
-    mb_rewind(ymultibuffer);
-    //mb_free(ymultibuffer);
-    //yMultibuffer = nbuffer;
-    yylineno = 0;
+    cu_rewind(unit);
 }
 
 static void init_crate(ShippingCrate *crate)
@@ -124,36 +109,87 @@ static void init_crate(ShippingCrate *crate)
     crate->libs = arr_create(5);
 
     crate->verbose = 0;
+    crate->lto = 0;
     crate->threadct = 0; // Let the compiler choose later
+    crate->codegen_units = 0; // Modules are compiled whole
+
+    crate->cache_dir = NULL;
+    crate->trace_file = NULL;
+
+    crate->optimize_ms = 0;
+    crate->emit_ms = 0;
+    crate->assemble_ms = 0;
+}
+
+// Skips the rest of the pipeline when an object for exactly this source,
+// import text and configuration is already in the cache
+static int cache_lookup(ShippingCrate *crate, CompilationUnit *unit)
+{
+    char key[BC_KEY_LEN + 1];
+    bc_module_key(unit->buffer, unit->include_rc, key);
+
+    unit->cached_object = bc_lookup(crate->cache_dir, key);
+    if(!unit->cached_object)
+    {
+        unit->cache_key = strdup(key);
+        return 0;
+    }
+
+    if(crate->verbose)
+        printf(BLUE "Cache hit" DEFAULT " -- %s\n", unit->filename);
+
+    mb_free(unit->buffer);
+    unit->buffer = NULL;
+
+    return 1;
 }
 
-static LLVMModuleRef compile_generic(ShippingCrate *crate, int include_rc, char *file)
+static void compile_generic(ShippingCrate *crate, CompilationUnit *unit)
 {
-    YY_BUFFER_STATE yybuf = yy_create_buffer(NULL, YY_BUF_SIZE);
-    yy_switch_to_buffer(yybuf);
+    // --lto needs the module of every unit, so only interfaces are cached
+    if(crate->cache_dir && !crate->lto && cache_lookup(crate, unit))
+        return;
 
     ty_prepare();
     if(IN(global_args, "--dump-code"))
     {
-        printf("Dump of:\n%s\n=================================================\n", file);
-        mb_print_all(ymultibuffer);
+        printf("Dump of:\n%s\n=================================================\n", unit->filename);
+        mb_print_all(unit->buffer);
         printf("\n\n");
 
-        return NULL;
+        return;
+    }
+
+    // File units are lexed along with their imports; the scanner is still
+    // what the parser finds the unit through
+    cu_open_scanner(unit, NULL);
+    if(!unit->tokens)
+    {
+        TraceSpan lex = trc_begin("lex");
+        cu_tokenize(unit);
+        trc_end(&lex);
     }
 
-    first_pass();
-    current_file_name = file;
+    mb_free(unit->buffer);
+    unit->buffer = NULL;
 
-    //mb_add_file(ymultibuffer, argv[1]);
+    TraceSpan first = trc_begin("first pass");
+    first_pass(unit);
+    trc_end(&first);
 
-    yyset_start_token(T_PARSE_PROGRAM);
-    yyparse();
+    current_file_name = unit->filename;
 
-    mb_free(ymultibuffer);
-    yy_delete_buffer(yybuf);
+    TraceSpan parse = trc_begin("parse");
+    unit->start_token = T_PARSE_PROGRAM;
+    yyparse(unit->scanner);
+    trc_end(&parse);
 
-    LLVMModuleRef module = ac_compile(ast_root, include_rc);
+    cu_close_scanner(unit);
+    cu_free_tokens(unit);
+
+    TraceSpan lower = trc_begin("lower");
+    LLVMModuleRef module = ac_compile(unit->ast_root, unit->include_rc);
+    trc_end(&lower);
 
     ty_teardown();
 
@@ -161,9 +197,18 @@ static LLVMModuleRef compile_generic(ShippingCrate *crate, int include_rc, char
         LLVMDumpModule(module);
 
     utl_free_registered();
+
+    if(crate->verbose)
+    {
+        long allocs;
+        size_t peak;
+        ast_arena_stats(&allocs, &peak);
+        printf(BLUE "Syntax tree" DEFAULT " -- %s: %ld allocations, %zu KB peak\n", unit->filename, allocs, peak / 1024);
+    }
+
     ast_free_nodes();
 
-    return module;
+    unit->module = module;
 }
 
 static char *make_argcode_name()
@@ -174,53 +219,95 @@ static char *make_argcode_name()
     return text;
 }
 
-static void compile_string(char *str, ShippingCrate *crate)
+static void compile_string(CompilationUnit *unit, ShippingCrate *crate)
 {
-    char *file = make_argcode_name();
-    ymultibuffer = mb_alloc();
-    mb_add_str(ymultibuffer, str);
-
-    // crate->current_file = make_argcode_name();
-    utl_set_current_context(LLVMContextCreate());
+    unit->buffer = mb_alloc();
+    mb_add_str(unit->buffer, unit->code);
 
     if(crate->verbose)
-        printf(BLUE "Compiling extra code" DEFAULT ": {{\n%s\n}}\n", str);
+        printf(BLUE "Compiling extra code" DEFAULT ": {{\n%s\n}}\n", unit->code);
 
-    LLVMModuleRef module = compile_generic(crate, !IN(global_args, "--no-rc"), file);
+    compile_generic(crate, unit);
+}
 
-    arr_append(&crate->work, thr_create_bundle(module, utl_get_current_context(), file));
+static void compile_rc(CompilationUnit *unit, ShippingCrate *crate)
+{
+    unit->buffer = mb_alloc();
+    mb_add_str(unit->buffer, rc_code);
 
-    // free(crate->current_file);
+    if(crate->verbose)
+        printf(BLUE "Compiling runtime\n" DEFAULT);
+
+    compile_generic(crate, unit);
 }
 
-static void compile_rc(ShippingCrate *crate)
+// `make` compiles the runtime once per reference counting mode and keeps
+// the objects next to the executable, so that linking a program does not
+// have to build it again. The embedded source is only compiled when they
+// are missing
+static char *find_runtime_object(const char *argv0)
 {
-    ymultibuffer = mb_alloc();
-    mb_add_str(ymultibuffer, rc_code);
+    const char *name = IN(global_args, "--rc=atomic") ? "runtime/rc-atomic.o" : "runtime/rc.o";
 
-    // crate->current_file = (char *)"__egl_rc_str.egl";
-    utl_set_current_context(LLVMContextCreate());
+    char *exe = realpath("/proc/self/exe", NULL);
+    if(!exe)
+        exe = realpath(argv0, NULL);
+    if(!exe)
+        return NULL;
+
+    char *dir = dirname(exe);
+    char *path = malloc(strlen(dir) + strlen(name) + 2);
+    sprintf(path, "%s/%s", dir, name);
+    free(exe);
+
+    if(access(path, R_OK) == 0)
+        return path;
+
+    free(path);
+    return NULL;
+}
+
+static void compile_file(CompilationUnit *unit, ShippingCrate *crate)
+{
+    TraceSpan imports = trc_begin("imports");
+    unit->buffer = imp_generate_imports(unit, crate->cache_dir);
+    mb_add_file(unit->buffer, unit->filename);
+    trc_end(&imports);
 
     if(crate->verbose)
-        printf(BLUE "Compiling runtime\n" DEFAULT);
+        printf(BLUE "Compiling file" DEFAULT " -- %s\n", unit->filename);
 
-    LLVMModuleRef module = compile_generic(crate, 0, (char *)"__egl_rc_str.egl");
-    arr_append(&crate->work, thr_create_bundle(module, utl_get_current_context(), (char *)"__egl_rc_str.egl"));
+    compile_generic(crate, unit);
 }
 
-static void compile_file(char *file, ShippingCrate *crate)
+// Runs on a front end worker thread; everything it touches is either
+// owned by the unit or thread local
+static void compile_unit(CompilationUnit *unit, ShippingCrate *crate)
 {
-    ymultibuffer = imp_generate_imports(file);
-    mb_add_file(ymultibuffer, file);
-    // crate->current_file = file;
+    cu_set_current(unit);
+    current_file_name = unit->filename;
+    trc_set_file(unit->filename);
+    TraceSpan span = trc_begin("front end");
 
-    utl_set_current_context(LLVMContextCreate());
+    unit->context = LLVMContextCreate();
+    utl_set_current_context(unit->context);
 
-    if(crate->verbose)
-        printf(BLUE "Compiling file" DEFAULT " -- %s\n", file);
+    switch(unit->kind)
+    {
+        case CUFile:
+            compile_file(unit, crate);
+            break;
+        case CUString:
+            compile_string(unit, crate);
+            break;
+        case CURuntime:
+            compile_rc(unit, crate);
+            break;
+    }
 
-    LLVMModuleRef module = compile_generic(crate, !IN(global_args, "--no-rc"), file);
-    arr_append(&crate->work, thr_create_bundle(module, utl_get_current_context(), file));
+    trc_end(&span);
+    trc_set_file(NULL);
+    cu_set_current(NULL);
 }
 
 static long getms()
@@ -266,28 +353,100 @@ int main(int argc, const char *argv[])
         die(-1, "No valid operands provided.");
     }
 
+    // Whole program optimization only applies when linking an executable
+    if(IN(global_args, "--lto"))
+    {
+        if(IN(global_args, "-c") || IN(global_args, "-S"))
+            warn(-1, "Ignoring --lto without linking");
+        else
+            crate.lto = 1;
+    }
+
+    if(IN(global_args, "--cache") && !crate.cache_dir)
+        crate.cache_dir = bc_default_dir();
+
+    // Only finished objects are cached
+    if(IN(global_args, "-S") || IN(global_args, "--llvm") || IN(global_args, "--dump-code"))
+        crate.cache_dir = NULL;
+
+    if(crate.cache_dir)
+        bc_prepare_dir(crate.cache_dir);
+
     if(crate.verbose)
         printf(BOLD "Starting build phase\n" DEFAULT);
 
     long start_time = getms();
 
+    trc_init(IN(global_args, "--time-report") != NULL, crate.trace_file);
+    TraceSpan build = trc_begin("build");
+
     thr_init();
     LLVMInitializeNativeTarget();
     LLVMInitializeNativeAsmPrinter();
 
+    int include_rc = !IN(global_args, "--no-rc");
+    Arraylist units = arr_create(crate.source_files.count + crate.extra_code.count + 1);
+
     int i;
     for(i = 0; i < crate.source_files.count; i++)
-        compile_file(crate.source_files.items[i], &crate);
+    {
+        CompilationUnit *unit = cu_create(CUFile, crate.source_files.items[i]);
+        unit->include_rc = include_rc;
+        arr_append(&units, unit);
+    }
 
     for(i = 0; i < crate.extra_code.count; i++)
-        compile_string(crate.extra_code.items[i], &crate);
+    {
+        CompilationUnit *unit = cu_create(CUString, make_argcode_name());
+        unit->code = crate.extra_code.items[i];
+        unit->include_rc = include_rc;
+        arr_append(&units, unit);
+    }
 
     if(!IN(global_args, "-c") && !IN(global_args, "--llvm") && !IN(global_args, "-h") &&
        !IN(global_args, "--dump-code") && !IN(global_args, "-S") && !IN(global_args, "--no-rc"))
-        compile_rc(&crate);
+    {
+        // Compiled from source under --lto so that it can be inlined
+        char *runtime = crate.lto ? NULL : find_runtime_object(argv[0]);
+        if(runtime)
+        {
+            if(crate.verbose)
+                printf(BLUE "Using precompiled runtime" DEFAULT " -- %s\n", runtime);
+            arr_append(&crate.object_files, runtime);
+        }
+        else
+            arr_append(&units, cu_create(CURuntime, (char *)"__egl_rc_str.egl"));
+    }
+
+    TraceSpan front = trc_begin("front end phase");
+    thr_compile_units(&crate, &units, compile_unit);
+    trc_end(&front);
+
+    // Units finish in any order, but modules are queued in source order so
+    // that output is deterministic
+    for(i = 0; i < units.count; i++)
+    {
+        CompilationUnit *unit = units.items[i];
+        ThreadingBundle *bundle = thr_create_bundle(unit->module, unit->context, unit->filename);
+        bundle->cached_object = unit->cached_object;
+        bundle->cache_key = unit->cache_key;
+        unit->cache_key = NULL;
+
+        arr_append(&crate.work, bundle);
+        cu_free(unit);
+    }
+
+    arr_free(&units);
+
+    if(crate.lto && !IN(global_args, "--dump-code") && !IN(global_args, "--llvm"))
+        lto_link_work(&crate);
 
     if(!IN(global_args, "--dump-code") && !IN(global_args, "--llvm"))
+    {
+        TraceSpan codegen = trc_begin("codegen phase");
         thr_produce_machine_code(&crate);
+        trc_end(&codegen);
+    }
 
     if(!IN(global_args, "-c") && !IN(global_args, "--llvm") && !IN(global_args, "-h") &&
        !IN(global_args, "--dump-code") && !IN(global_args, "-S"))
@@ -299,6 +458,9 @@ int main(int argc, const char *argv[])
 
     thr_teardown();
 
+    trc_end(&build);
+    trc_finish();
+
     long end_time = getms();
 
     if(crate.verbose)
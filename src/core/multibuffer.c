@@ -123,7 +123,6 @@ size_t min(size_t a, size_t b)
     return a < b ? a : b;
 }
 
-extern int yylineno;
 int mb_buffer(Multibuffer *buf, char *dest, size_t max_size)
 {
     Mbnode *n = buf->cur;
@@ -211,22 +210,27 @@ void mb_print_all(Multibuffer *buf)
     }
 }
 
+static void mb_free_node(Mbnode *n)
+{
+    switch(n->type)
+    {
+        case MBFILE:
+            fclose(n->src.f);
+            break;
+        case MBSTR:
+            free(n->src.s);
+            break;
+    }
+    free(n);
+}
+
 void mb_free(Multibuffer *buf)
 {
     Mbnode *n = buf->head;
     while(n)
     {
         Mbnode *o = n->next;
-        switch(n->type)
-        {
-            case MBFILE:
-                fclose(n->src.f);
-                break;
-            case MBSTR:
-                free(n->src.s);
-                break;
-        }
-        free(n);
+        mb_free_node(n);
         n = o;
     }
 
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include "partition.h"
+#include "buildcache.h"
+#include "config.h"
+#include "cpp/cpp.h"
+
+// The module is copied into each partition through bitcode, since a
+// context cannot be shared between threads. Functions are handed out
+// largest first to the partition with the least code so far, and globals
+// all live in the first partition. Local symbols that another partition
+// may refer to are promoted to hidden globals.
+
+typedef struct {
+    LLVMValueRef func;
+    int index;
+    long size;
+    int owner;
+} PrtFunction;
+
+long prt_function_size(LLVMValueRef func)
+{
+    long size = 0;
+
+    LLVMBasicBlockRef block;
+    for(block = LLVMGetFirstBasicBlock(func); block; block = LLVMGetNextBasicBlock(block))
+    {
+        LLVMValueRef inst;
+        for(inst = LLVMGetFirstInstruction(block); inst; inst = LLVMGetNextInstruction(inst))
+            size++;
+    }
+
+    return size;
+}
+
+static int prt_is_local(LLVMValueRef value)
+{
+    LLVMLinkage linkage = LLVMGetLinkage(value);
+    return linkage == LLVMPrivateLinkage || linkage == LLVMInternalLinkage;
+}
+
+// Local helpers that are always inlined (the reference counting ones) are
+// copied into every partition instead, so that each can still inline them
+static int prt_is_shared(LLVMValueRef func)
+{
+    return prt_is_local(func) && EGLIsAlwaysInline(func);
+}
+
+static int prt_is_split(LLVMValueRef func)
+{
+    return !LLVMIsDeclaration(func) && !prt_is_shared(func);
+}
+
+// The suffix keeps promoted symbols apart from those of other sources that
+// end up in the same link
+static void prt_promote(LLVMValueRef value, const char *suffix)
+{
+    const char *name = LLVMGetValueName(value);
+    char *promoted = malloc(strlen(name) + strlen(suffix) + 1);
+    sprintf(promoted, "%s%s", name, suffix);
+
+    LLVMSetValueName(value, promoted);
+    LLVMSetLinkage(value, LLVMExternalLinkage);
+    LLVMSetVisibility(value, LLVMHiddenVisibility);
+
+    free(promoted);
+}
+
+static int prt_compare(const void *a, const void *b)
+{
+    const PrtFunction *fa = *(PrtFunction *const *)a;
+    const PrtFunction *fb = *(PrtFunction *const *)b;
+
+    if(fa->size != fb->size)
+        return fa->size < fb->size ? 1 : -1;
+
+    return fa->index - fb->index;
+}
+
+static void prt_assign(PrtFunction *funcs, int total, int count)
+{
+    PrtFunction **order = malloc(total * sizeof(PrtFunction *));
+    long load[count];
+
+    int i;
+    for(i = 0; i < total; i++)
+        order[i] = funcs + i;
+    for(i = 0; i < count; i++)
+        load[i] = 0;
+
+    qsort(order, total, sizeof(PrtFunction *), prt_compare);
+
+    for(i = 0; i < total; i++)
+    {
+        int least = 0;
+        int j;
+        for(j = 1; j < count; j++)
+            if(load[j] < load[least])
+                least = j;
+
+        order[i]->owner = least;
+        load[least] += order[i]->size;
+    }
+
+    free(order);
+}
+
+int prt_split_module(LLVMModuleRef module, const char *filename, int count,
+                     LLVMModuleRef *parts, LLVMContextRef *contexts)
+{
+    int total = 0;
+
+    LLVMValueRef func;
+    for(func = LLVMGetFirstFunction(module); func; func = LLVMGetNextFunction(func))
+        if(prt_is_split(func))
+            total++;
+
+    if(count > total)
+        count = total;
+    if(count < 2)
+        return 0;
+
+    PrtFunction *funcs = malloc(total * sizeof(PrtFunction));
+
+    int i = 0;
+    for(func = LLVMGetFirstFunction(module); func; func = LLVMGetNextFunction(func))
+    {
+        if(!prt_is_split(func))
+            continue;
+
+        funcs[i].func = func;
+        funcs[i].index = i;
+        funcs[i].size = prt_function_size(func);
+        i++;
+    }
+
+    prt_assign(funcs, total, count);
+
+    BCHash h;
+    bc_hash_init(&h);
+    bc_hash_str(&h, filename);
+
+    char key[BC_KEY_LEN + 1];
+    bc_hash_hex(&h, key);
+
+    char suffix[20];
+    sprintf(suffix, ".cgu.%.8s", key);
+
+    for(i = 0; i < total; i++)
+        if(prt_is_local(funcs[i].func))
+            prt_promote(funcs[i].func, suffix);
+
+    LLVMValueRef glob;
+    for(glob = LLVMGetFirstGlobal(module); glob; glob = LLVMGetNextGlobal(glob))
+        if(prt_is_local(glob))
+            prt_promote(glob, suffix);
+
+    LLVMMemoryBufferRef bitcode = LLVMWriteBitcodeToMemoryBuffer(module);
+
+    int p;
+    for(p = 0; p < count; p++)
+    {
+        char *error = NULL;
+        contexts[p] = LLVMContextCreate();
+        if(LLVMParseBitcodeInContext(contexts[p], bitcode, parts + p, &error))
+            die(-1, "Internal compiler error: could not partition %s (%s)", filename, error);
+
+        // Bitcode keeps the function order, so the i-th split function
+        // here is the i-th one above
+        i = 0;
+        for(func = LLVMGetFirstFunction(parts[p]); func; func = LLVMGetNextFunction(func))
+        {
+            if(!prt_is_split(func))
+                continue;
+
+            if(funcs[i++].owner != p)
+                EGLMakeDeclaration(func);
+        }
+
+        if(!p)
+            continue;
+
+        for(glob = LLVMGetFirstGlobal(parts[p]); glob; glob = LLVMGetNextGlobal(glob))
+            if(!LLVMIsDeclaration(glob))
+                EGLMakeDeclaration(glob);
+    }
+
+    LLVMDisposeMemoryBuffer(bitcode);
+    free(funcs);
+
+    return count;
+}
@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include "llvm_headers.h"
+
+// Modules smaller than this many instructions are not worth splitting
+#define PRT_MIN_SIZE 2000
+
+long prt_function_size(LLVMValueRef func);
+
+// Splits module into at most count partitions for --codegen-units, each in
+// a context of its own so they can be optimized on separate threads. Every
+// function body ends up in exactly one partition and every global in the
+// first; the rest see declarations. Returns the number of partitions made,
+// or 0 (leaving module untouched) when there is nothing to split.
+int prt_split_module(LLVMModuleRef module, const char *filename, int count,
+                     LLVMModuleRef *parts, LLVMContextRef *contexts);
+
+#endif
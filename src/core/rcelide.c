@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "rcelide.h"
+#include "hashtable.h"
+#include "arraylist.h"
+
+// Works on the module before the reference counting helpers are inlined,
+// while every operation is still a single call. Within a block, an
+// increment of a value followed by a decrement of the same value cancels
+// out: the decrement only has to free the object if its count was zero to
+// begin with, which is what __egl_rc_check does. This is only safe when
+// nothing in between can add references or touch the object, so anything
+// other than local variable traffic and casts ends the window. That
+// includes releasing any other object, whose teardown may drop the last
+// reference that kept the pending one alive.
+//
+// Values are matched after looking through casts and through loads of
+// local variables whose address never escapes, so that a value passed
+// straight through (loaded, incremented, stored, later reloaded and
+// decremented) is recognized as the same object.
+
+typedef struct {
+    LLVMValueRef incr;
+    LLVMValueRef decr;
+    LLVMValueRef check;
+
+    Hashtable locals;   // alloca -> 1 if only ever loaded and stored
+    Hashtable current;  // alloca -> value it currently holds in this block
+    Hashtable loaded;   // load -> value it produced
+    Arraylist open;     // unmatched increments in this block
+
+    int removed;
+} RCElider;
+
+typedef struct {
+    LLVMValueRef call;
+    LLVMValueRef value;
+} RCOpen;
+
+static long rce_hash(void *k, void *d)
+{
+    return (long)k;
+}
+
+static int rce_equ(void *k, void *d)
+{
+    return k == d;
+}
+
+static LLVMValueRef rce_callee(LLVMValueRef inst)
+{
+    if(!LLVMIsACallInst(inst))
+        return NULL;
+
+    return LLVMGetOperand(inst, LLVMGetNumOperands(inst) - 1);
+}
+
+static int rce_is_local(RCElider *rc, LLVMValueRef alloca)
+{
+    if(!LLVMIsAAllocaInst(alloca))
+        return 0;
+
+    if(hst_contains_key(&rc->locals, alloca, rce_hash, rce_equ))
+        return hst_get(&rc->locals, alloca, rce_hash, rce_equ) != NULL;
+
+    long local = 1;
+    LLVMUseRef use;
+    for(use = LLVMGetFirstUse(alloca); use && local; use = LLVMGetNextUse(use))
+    {
+        LLVMValueRef user = LLVMGetUser(use);
+        if(LLVMIsALoadInst(user))
+            continue;
+        if(LLVMIsAStoreInst(user) && LLVMGetOperand(user, 0) != alloca)
+            continue;
+        local = 0;
+    }
+
+    hst_put(&rc->locals, alloca, (void *)local, rce_hash, rce_equ);
+    return local;
+}
+
+static LLVMValueRef rce_strip(RCElider *rc, LLVMValueRef val)
+{
+    for(;;)
+    {
+        if(LLVMIsABitCastInst(val) || (LLVMIsAConstantExpr(val) && LLVMGetConstOpcode(val) == LLVMBitCast))
+            val = LLVMGetOperand(val, 0);
+        else if(LLVMIsALoadInst(val) && hst_contains_key(&rc->loaded, val, rce_hash, rce_equ))
+            val = hst_get(&rc->loaded, val, rce_hash, rce_equ);
+        else
+            return val;
+    }
+}
+
+static void rce_remember_load(RCElider *rc, LLVMValueRef load)
+{
+    LLVMValueRef from = LLVMGetOperand(load, 0);
+    if(!rce_is_local(rc, from))
+        return;
+
+    LLVMValueRef held = hst_get(&rc->current, from, rce_hash, rce_equ);
+    if(!held)
+    {
+        held = load;
+        hst_put(&rc->current, from, held, rce_hash, rce_equ);
+    }
+
+    hst_put(&rc->loaded, load, held, rce_hash, rce_equ);
+}
+
+static void rce_remember_store(RCElider *rc, LLVMValueRef store)
+{
+    LLVMValueRef to = LLVMGetOperand(store, 1);
+    if(rce_is_local(rc, to))
+        hst_put(&rc->current, to, rce_strip(rc, LLVMGetOperand(store, 0)), rce_hash, rce_equ);
+}
+
+static void rce_close_window(RCElider *rc)
+{
+    int i;
+    for(i = 0; i < rc->open.count; i++)
+        free(rc->open.items[i]);
+    rc->open.count = 0;
+}
+
+// Returns 1 if the decrement was cancelled against an earlier increment
+static int rce_cancel(RCElider *rc, LLVMValueRef decr, LLVMValueRef value, LLVMBuilderRef builder)
+{
+    int i;
+    for(i = rc->open.count - 1; i >= 0; i--)
+    {
+        RCOpen *o = rc->open.items[i];
+        if(o->value != value)
+            continue;
+
+        LLVMPositionBuilderBefore(builder, decr);
+        LLVMValueRef arg = LLVMGetOperand(decr, 0);
+        LLVMBuildCall(builder, rc->check, &arg, 1, "");
+
+        LLVMInstructionEraseFromParent(decr);
+        LLVMInstructionEraseFromParent(o->call);
+
+        free(o);
+        arr_remove(&rc->open, NULL, i);
+        rc->removed++;
+        return 1;
+    }
+
+    return 0;
+}
+
+static void rce_block(RCElider *rc, LLVMBasicBlockRef block, LLVMBuilderRef builder)
+{
+    hst_free(&rc->current);
+    hst_free(&rc->loaded);
+    rc->current = hst_create();
+    rc->loaded = hst_create();
+    rce_close_window(rc);
+
+    LLVMValueRef inst, next;
+    for(inst = LLVMGetFirstInstruction(block); inst; inst = next)
+    {
+        next = LLVMGetNextInstruction(inst);
+
+        LLVMValueRef callee = rce_callee(inst);
+        if(callee == rc->incr)
+        {
+            // Another reference may keep a pending object alive past its
+            // decrement, so earlier increments can no longer be cancelled
+            rce_close_window(rc);
+
+            RCOpen *o = malloc(sizeof(RCOpen));
+            o->call = inst;
+            o->value = rce_strip(rc, LLVMGetOperand(inst, 0));
+            arr_append(&rc->open, o);
+        }
+        else if(callee == rc->decr || callee == rc->check)
+        {
+            LLVMValueRef value = rce_strip(rc, LLVMGetOperand(inst, 0));
+            if(LLVMIsNull(value))
+            {
+                LLVMInstructionEraseFromParent(inst);
+                rc->removed++;
+            }
+            else if(callee == rc->check || !rce_cancel(rc, inst, value, builder))
+                rce_close_window(rc);
+        }
+        else if(LLVMIsALoadInst(inst))
+        {
+            if(rce_is_local(rc, LLVMGetOperand(inst, 0)))
+                rce_remember_load(rc, inst);
+            else
+                rce_close_window(rc);
+        }
+        else if(LLVMIsAStoreInst(inst))
+        {
+            if(rce_is_local(rc, LLVMGetOperand(inst, 1)))
+                rce_remember_store(rc, inst);
+            else
+                rce_close_window(rc);
+        }
+        else if(!LLVMIsACastInst(inst) && !LLVMIsAAllocaInst(inst) && !LLVMIsAGetElementPtrInst(inst))
+            rce_close_window(rc);
+    }
+}
+
+int rce_run(LLVMModuleRef module)
+{
+    RCElider rc;
+    rc.incr = LLVMGetNamedFunction(module, "__egl_rc_incr");
+    rc.decr = LLVMGetNamedFunction(module, "__egl_rc_decr");
+    rc.check = LLVMGetNamedFunction(module, "__egl_rc_check");
+
+    if(!rc.incr || !rc.decr || !rc.check)
+        return 0;
+
+    rc.open = arr_create(10);
+    rc.current = hst_create();
+    rc.loaded = hst_create();
+    rc.removed = 0;
+
+    LLVMBuilderRef builder = LLVMCreateBuilderInContext(LLVMGetModuleContext(module));
+
+    LLVMValueRef func;
+    for(func = LLVMGetFirstFunction(module); func; func = LLVMGetNextFunction(func))
+    {
+        if(func == rc.incr || func == rc.decr || func == rc.check)
+            continue;
+
+        rc.locals = hst_create();
+
+        LLVMBasicBlockRef block;
+        for(block = LLVMGetFirstBasicBlock(func); block; block = LLVMGetNextBasicBlock(block))
+            rce_block(&rc, block, builder);
+
+        hst_free(&rc.locals);
+    }
+
+    rce_close_window(&rc);
+    arr_free(&rc.open);
+    hst_free(&rc.current);
+    hst_free(&rc.loaded);
+    LLVMDisposeBuilder(builder);
+
+    return rc.removed;
+}
@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef RCELIDE_H
+#define RCELIDE_H
+
+#include "llvm_headers.h"
+
+int rce_run(LLVMModuleRef module);
+
+#endif
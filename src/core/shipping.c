@@ -19,28 +19,40 @@
 #include "stringbuilder.h"
 #include "threading.h"
 #include "mempool.h"
+#include "rcelide.h"
+#include "trace.h"
 
 extern Hashtable global_args;
 typedef LLVMPassManagerBuilderRef LPMB;
 
 static void shp_spawn_process(const char *process, const char *args[]);
 
-void shp_optimize(LLVMModuleRef module)
+static unsigned shp_opt_level()
 {
-    LPMB passBuilder = LLVMPassManagerBuilderCreate();
-    LLVMPassManagerRef pm = LLVMCreatePassManager();
-
-    unsigned opt = 2;
-
     if(IN(global_args, "-O0"))
-        opt = 0;
+        return 0;
     else if(IN(global_args, "-O1"))
-        opt = 1;
+        return 1;
     else if(IN(global_args, "-O3"))
-        opt = 3;
+        return 3;
 
-    LLVMPassManagerBuilderSetOptLevel(passBuilder, opt);
+    return 2;
+}
 
+// Has to see the reference counting helpers before they are inlined
+int shp_elide(LLVMModuleRef module)
+{
+    return shp_opt_level() ? rce_run(module) : 0;
+}
+
+void shp_run_passes(LLVMModuleRef module)
+{
+    LPMB passBuilder = LLVMPassManagerBuilderCreate();
+    LLVMPassManagerRef pm = LLVMCreatePassManager();
+
+    LLVMPassManagerBuilderSetOptLevel(passBuilder, shp_opt_level());
+
+    LLVMAddAlwaysInlinerPass(pm);
     thr_populate_pass_manager(passBuilder, pm);
 
     LLVMTargetDataRef td = LLVMCreateTargetData("");
@@ -51,6 +63,18 @@ void shp_optimize(LLVMModuleRef module)
     LLVMPassManagerBuilderDispose(passBuilder);
 }
 
+int shp_optimize(LLVMModuleRef module)
+{
+    TraceSpan span = trc_begin("optimize");
+
+    int elided = shp_elide(module);
+    shp_run_passes(module);
+
+    trc_end(&span);
+
+    return elided;
+}
+
 char *shp_switch_file_ext(char *orig, const char *n)
 {
     char *out = malloc(strlen(orig) + strlen(n) + 1);
@@ -73,6 +97,34 @@ char *shp_switch_file_ext(char *orig, const char *n)
     return out;
 }
 
+static LLVMTargetMachineRef shp_create_target_machine()
+{
+    char *triple = LLVMGetDefaultTargetTriple();
+
+    LLVMTargetRef targ;
+    LLVMGetTargetFromTriple(triple, &targ, NULL);
+    LLVMTargetMachineRef tm =
+        LLVMCreateTargetMachine(targ, triple,
+                                "", "", LLVMCodeGenLevelNone,
+                                LLVMRelocDefault, LLVMCodeModelDefault);
+
+    LLVMDisposeMessage(triple);
+    return tm;
+}
+
+static void shp_emit(LLVMModuleRef module, char *ofn, LLVMCodeGenFileType type)
+{
+    TraceSpan span = trc_begin("emit");
+    LLVMTargetMachineRef tm = shp_create_target_machine();
+
+    char *error = NULL;
+    if(LLVMTargetMachineEmitToFile(tm, module, ofn, type, &error))
+        die(-1, "Internal compiler error: could not write %s (%s)", ofn, error);
+
+    LLVMDisposeTargetMachine(tm);
+    trc_end(&span);
+}
+
 void shp_produce_assembly(LLVMModuleRef module, char *filename, char **outname)
 {
     char *ofn = NULL;
@@ -82,18 +134,34 @@ void shp_produce_assembly(LLVMModuleRef module, char *filename, char **outname)
     else
         ofn = thr_temp_assembly_file(filename);
 
-    LLVMTargetRef targ;
-    LLVMGetTargetFromTriple(LLVMGetDefaultTargetTriple(), &targ, NULL);
-    LLVMTargetMachineRef tm =
-        LLVMCreateTargetMachine(targ, LLVMGetDefaultTargetTriple(),
-                                "", "", LLVMCodeGenLevelNone,
-                                LLVMRelocDefault, LLVMCodeModelDefault);
+    shp_emit(module, ofn, LLVMAssemblyFile);
 
-    LLVMTargetMachineEmitToFile(tm, module, ofn, LLVMAssemblyFile, NULL);
+    *outname = ofn;
+}
+
+void shp_produce_object(LLVMModuleRef module, char *filename, char **outname)
+{
+    char *ofn = NULL;
+
+    if(IN(global_args, "-c"))
+        ofn = shp_switch_file_ext(filename, "o");
+    else
+        ofn = thr_temp_object_file(filename);
+
+    shp_emit(module, ofn, LLVMObjectFile);
 
     *outname = ofn;
+}
 
-    LLVMDisposeTargetMachine(tm);
+// Partitions of a module always go to temporary objects; -c gets the
+// combined one
+void shp_produce_partition(LLVMModuleRef module, char *filename, char **outname)
+{
+    char *ofn = thr_temp_object_file(filename);
+
+    shp_emit(module, ofn, LLVMObjectFile);
+
+    *outname = ofn;
 }
 
 void shp_produce_binary(char *filename, char *assemblyname, char **outname)
@@ -113,7 +181,39 @@ void shp_produce_binary(char *filename, char *assemblyname, char **outname)
         SystemCC, "-c", assemblyname, "-o", outfile, "-g", "-O0", NULL
     };
 
+    TraceSpan span = trc_begin("assemble");
     shp_spawn_process(SystemCC, command);
+    trc_end(&span);
+
+    *outname = outfile;
+}
+
+// Links the objects of a partitioned module back into one relocatable
+// object, for -c and the object cache
+void shp_combine_objects(char *filename, char **objects, int count, char **outname)
+{
+    char *outfile = NULL;
+
+    if(IN(global_args, "-c"))
+        outfile = shp_switch_file_ext(filename, "o");
+    else
+        outfile = thr_temp_object_file(filename);
+
+    const char *args[count + 6];
+    args[0] = SystemCC;
+    args[1] = "-r";
+    args[2] = "-nostdlib";
+    args[3] = "-o";
+    args[4] = outfile;
+
+    for(int i = 0; i < count; i++)
+        args[i + 5] = objects[i];
+
+    args[count + 5] = NULL;
+
+    TraceSpan span = trc_begin("combine");
+    shp_spawn_process(SystemCC, args);
+    trc_end(&span);
 
     *outname = outfile;
 }
@@ -139,7 +239,9 @@ void shp_produce_executable(ShippingCrate *crate)
 
     args[arg_count - 1] = NULL;
 
+    TraceSpan span = trc_begin("link");
     shp_spawn_process(SystemCC, args);
+    trc_end(&span);
 }
 
 static void shp_spawn_process(const char *process, const char *args[])
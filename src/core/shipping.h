@@ -16,6 +16,7 @@
 
 typedef struct {
     unsigned verbose : 1;
+    unsigned lto : 1;
 
     Arraylist source_files;
     Arraylist object_files;
@@ -23,14 +24,26 @@ typedef struct {
     Arraylist work;
     Arraylist libs;
 
-    int widex;
-
     int threadct;
+    int codegen_units;
+
+    char *cache_dir;
+    char *trace_file;
+
+    double optimize_ms;
+    double emit_ms;
+    double assemble_ms;
 } ShippingCrate;
 
-void shp_optimize(LLVMModuleRef module);
+int shp_optimize(LLVMModuleRef module);
+int shp_elide(LLVMModuleRef module);
+void shp_run_passes(LLVMModuleRef module);
+char *shp_switch_file_ext(char *orig, const char *n);
 void shp_produce_assembly(LLVMModuleRef module, char *filename, char **outname);
+void shp_produce_object(LLVMModuleRef module, char *filename, char **outname);
+void shp_produce_partition(LLVMModuleRef module, char *filename, char **outname);
 void shp_produce_binary(char *filename, char *assemblyname, char **outname);
+void shp_combine_objects(char *filename, char **objects, int count, char **outname);
 void shp_produce_executable(ShippingCrate *crate);
 
 #endif
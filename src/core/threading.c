@@ -12,11 +12,15 @@
 #include <stdio.h>
 #include <libgen.h>
 #include <unistd.h>
+#include <sys/time.h>
 #include "threading.h"
 #include "config.h"
 #include "mempool.h"
 #include "hashtable.h"
 #include "colors.h"
+#include "buildcache.h"
+#include "trace.h"
+#include "partition.h"
 
 extern Hashtable global_args;
 
@@ -33,6 +37,7 @@ typedef pthread_t th_thread;
 #define th_unlock(mut) pthread_mutex_unlock(&(mut))
 #define th_destroy_mutex(mut) pthread_mutex_destroy(&(mut))
 #define th_split(thread, func, data) pthread_create(&(thread), NULL, (func), (data))
+#define th_split_deep(thread, func, data) thr_pthread_create_deep(&(thread), (func), (data))
 #define th_join(thread) pthread_join((thread), NULL)
 #define threadct() thr_pthread_sys_count()
 
@@ -46,6 +51,7 @@ typedef int th_thread;
 #define th_destroy_mutex(mut)
 #define threadct() 1
 #define th_split(thread, func, data) (func)(data)
+#define th_split_deep(thread, func, data) (func)(data)
 #define th_join(thread)
 
 #endif
@@ -53,31 +59,127 @@ typedef int th_thread;
 #ifdef THREADING
 static th_mutex number_lock;
 static th_mutex name_lock;
-static th_mutex work_lock;
+static th_mutex unit_lock;
 static th_mutex obj_lock;
 static th_mutex llvm_lock;
+static th_mutex time_lock;
 #endif
 
 static Mempool unlink_pool;
 
+// Code generation work is spread over one deque per worker, seeded
+// largest module first. A worker takes from the front of its own deque and,
+// once that is empty, steals from the back of whichever deque has the most
+// work left
+typedef struct {
+    th_mutex lock;
+    int *items;
+    int head;
+    int tail;
+    long load;
+} WorkDeque;
+
+typedef struct {
+    WorkDeque *deques;
+    int count;
+    long *sizes;
+} Scheduler;
+
 typedef struct {
     ShippingCrate *crate;
+    Scheduler *sched;
     int thread_num;
     char **outputfiles;
+
+    double optimize_ms;
+    double emit_ms;
+    double assemble_ms;
 } ProcData;
 
+typedef struct {
+    ShippingCrate *crate;
+    Arraylist *units;
+    int *next;
+    thr_unit_function func;
+} UnitProcData;
+
+#define FRONT_END_STACK_SIZE (64 * 1024 * 1024)
+
 #ifdef HAS_PTHREAD
 
+// A CPU quota of a cgroup (as set by container runtimes) caps how many
+// threads can usefully run even when more cores are online
+static int thr_cgroup_cpus()
+{
+    long quota = -1, period = 0;
+
+    FILE *f = fopen("/sys/fs/cgroup/cpu.max", "r");
+    if(f)
+    {
+        char buf[32];
+        if(fscanf(f, "%31s %ld", buf, &period) == 2 && strcmp(buf, "max"))
+            quota = atol(buf);
+        fclose(f);
+    }
+    else if((f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r")))
+    {
+        if(fscanf(f, "%ld", &quota) != 1)
+            quota = -1;
+        fclose(f);
+
+        if((f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r")))
+        {
+            if(fscanf(f, "%ld", &period) != 1)
+                period = 0;
+            fclose(f);
+        }
+    }
+
+    if(quota <= 0 || period <= 0)
+        return 0;
+
+    return (quota + period - 1) / period;
+}
+
 int thr_pthread_sys_count()
 {
     if(!LLVMIsMultithreaded())
         return 1;
 
-    return 4;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if(cpus < 1)
+        cpus = 1;
+
+    int quota = thr_cgroup_cpus();
+    if(quota && quota < cpus)
+        cpus = quota;
+
+    return cpus;
+}
+
+// The parser and the AST lowering are both deeply recursive, so front end
+// workers get a stack as large as the main thread would have
+static int thr_pthread_create_deep(pthread_t *thread, void *(*func)(void *), void *data)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, FRONT_END_STACK_SIZE);
+
+    int res = pthread_create(thread, &attr, func, data);
+    pthread_attr_destroy(&attr);
+
+    return res;
 }
 
 #endif
 
+static double thr_getms()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
 void strip_ext(char *base)
 {
     int i;
@@ -105,9 +207,10 @@ void thr_init()
 {
     th_init_mutex(number_lock);
     th_init_mutex(name_lock);
-    th_init_mutex(work_lock);
+    th_init_mutex(unit_lock);
     th_init_mutex(obj_lock);
     th_init_mutex(llvm_lock);
+    th_init_mutex(time_lock);
 
     unlink_pool = pool_create();
     unlink_pool.free_func = (void (*)(void *))unlink;
@@ -119,9 +222,10 @@ void thr_teardown()
 
     th_destroy_mutex(number_lock);
     th_destroy_mutex(name_lock);
-    th_destroy_mutex(work_lock);
+    th_destroy_mutex(unit_lock);
     th_destroy_mutex(obj_lock);
     th_destroy_mutex(llvm_lock);
+    th_destroy_mutex(time_lock);
 }
 
 ThreadingBundle *thr_create_bundle(LLVMModuleRef module, LLVMContextRef context, char *filename)
@@ -131,6 +235,10 @@ ThreadingBundle *thr_create_bundle(LLVMModuleRef module, LLVMContextRef context,
     bundle->context = context;
     bundle->module = module;
     bundle->assemblyname = NULL;
+    bundle->cache_key = NULL;
+    bundle->cached_object = NULL;
+    bundle->part = bundle->part_count = 0;
+    bundle->optimized = 0;
 
     return bundle;
 }
@@ -142,41 +250,337 @@ void thr_populate_pass_manager(LLVMPassManagerBuilderRef pbr, LLVMPassManagerRef
     th_unlock(llvm_lock);
 }
 
-ThreadingBundle *thr_get_next_work(ShippingCrate *crate, int *idx)
+static long thr_module_size(LLVMModuleRef module)
+{
+    long size = 0;
+
+    LLVMValueRef func;
+    for(func = LLVMGetFirstFunction(module); func; func = LLVMGetNextFunction(func))
+        size += prt_function_size(func);
+
+    return size;
+}
+
+// Replaces a large module with its partitions, appended to work, and
+// returns how many there are; returns 0 if the module is compiled whole
+static int thr_split_bundle(ShippingCrate *crate, ThreadingBundle *bundle, Arraylist *work, int thrct)
+{
+    int count = crate->codegen_units;
+
+    // A whole program module is split across the threads unless told otherwise
+    if(!count && bundle->optimized)
+        count = thrct;
+
+    // Assembly output is one file per source
+    if(count < 2 || bundle->cached_object || IN(global_args, "-S") || IN(global_args, "--external-as"))
+        return 0;
+
+    if(thr_module_size(bundle->module) < PRT_MIN_SIZE)
+        return 0;
+
+    TraceSpan span = trc_begin("partition");
+    LLVMModuleRef parts[count];
+    LLVMContextRef contexts[count];
+    count = prt_split_module(bundle->module, bundle->filename, count, parts, contexts);
+    trc_end(&span);
+
+    if(!count)
+        return 0;
+
+    int i;
+    for(i = 0; i < count; i++)
+    {
+        ThreadingBundle *part = thr_create_bundle(parts[i], contexts[i], bundle->filename);
+        part->part = i + 1;
+        part->part_count = count;
+        part->optimized = bundle->optimized;
+        arr_append(work, part);
+    }
+
+    LLVMDisposeModule(bundle->module);
+    bundle->module = NULL;
+
+    if(crate->verbose)
+        printf(BLUE "Module (%s)" DEFAULT " -- split into %d codegen units\n", bundle->filename, count);
+
+    return count;
+}
+
+static long *thr_sort_sizes;
+
+static int thr_compare_work(const void *a, const void *b)
+{
+    long sa = thr_sort_sizes[*(const int *)a];
+    long sb = thr_sort_sizes[*(const int *)b];
+
+    if(sa != sb)
+        return sa < sb ? 1 : -1;
+
+    return *(const int *)a - *(const int *)b;
+}
+
+// Hands the modules out largest first, each to the deque with the least
+// work so far
+static void thr_seed_scheduler(Scheduler *sched, ShippingCrate *crate, int thrct)
+{
+    int count = crate->work.count;
+    int order[count];
+
+    sched->count = thrct;
+    sched->sizes = malloc(count * sizeof(long));
+    sched->deques = malloc(thrct * sizeof(WorkDeque));
+
+    int i;
+    for(i = 0; i < count; i++)
+    {
+        ThreadingBundle *bundle = crate->work.items[i];
+        sched->sizes[i] = bundle->cached_object ? 0 : thr_module_size(bundle->module);
+        order[i] = i;
+    }
+
+    thr_sort_sizes = sched->sizes;
+    qsort(order, count, sizeof(int), thr_compare_work);
+
+    for(i = 0; i < thrct; i++)
+    {
+        WorkDeque *dq = sched->deques + i;
+        th_init_mutex(dq->lock);
+        dq->items = malloc(count * sizeof(int));
+        dq->head = dq->tail = 0;
+        dq->load = 0;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        WorkDeque *least = sched->deques;
+        int j;
+        for(j = 1; j < thrct; j++)
+            if(sched->deques[j].load < least->load)
+                least = sched->deques + j;
+
+        least->items[least->tail++] = order[i];
+        least->load += sched->sizes[order[i]];
+    }
+}
+
+static void thr_free_scheduler(Scheduler *sched)
+{
+    int i;
+    for(i = 0; i < sched->count; i++)
+    {
+        th_destroy_mutex(sched->deques[i].lock);
+        free(sched->deques[i].items);
+    }
+
+    free(sched->deques);
+    free(sched->sizes);
+}
+
+// Returns the index into crate->work of the next module to compile, or -1
+// once every deque is empty
+static int thr_take_work(Scheduler *sched, WorkDeque *dq, int steal)
 {
-    th_lock(work_lock);
-    ThreadingBundle *out = NULL;
+    int idx = -1;
 
-    if(crate->widex < crate->work.count)
-        out = crate->work.items[crate->widex++];
+    th_lock(dq->lock);
+    if(dq->head < dq->tail)
+    {
+        idx = steal ? dq->items[--dq->tail] : dq->items[dq->head++];
+        dq->load -= sched->sizes[idx];
+    }
+    th_unlock(dq->lock);
 
-    *idx = crate->widex - 1;
+    return idx;
+}
 
-    th_unlock(work_lock);
+// The work left in a deque, or -1 if it is empty. Owners push and pop
+// concurrently, so even this probe goes through the lock
+static long thr_deque_load(WorkDeque *dq)
+{
+    th_lock(dq->lock);
+    long load = dq->head < dq->tail ? dq->load : -1;
+    th_unlock(dq->lock);
+
+    return load;
+}
+
+ThreadingBundle *thr_get_next_work(ProcData *pd, int *idx)
+{
+    Scheduler *sched = pd->sched;
+
+    *idx = thr_take_work(sched, sched->deques + pd->thread_num - 1, 0);
+    while(*idx < 0)
+    {
+        // The victim may be emptied between the probe and the take, which
+        // rechecks under the lock
+        WorkDeque *victim = NULL;
+        long most = -1;
+        int i;
+        for(i = 0; i < sched->count; i++)
+        {
+            long load = thr_deque_load(sched->deques + i);
+            if(load > most)
+            {
+                victim = sched->deques + i;
+                most = load;
+            }
+        }
+
+        if(!victim)
+            return NULL;
+
+        *idx = thr_take_work(sched, victim, 1);
+    }
+
+    return pd->crate->work.items[*idx];
+}
+
+CompilationUnit *thr_get_next_unit(UnitProcData *ud)
+{
+    th_lock(unit_lock);
+    CompilationUnit *out = NULL;
+
+    if(*ud->next < ud->units->count)
+        out = ud->units->items[(*ud->next)++];
+
+    th_unlock(unit_lock);
 
     return out;
 }
 
+void *thr_unit_proc(void *data)
+{
+    UnitProcData *ud = data;
+    CompilationUnit *unit;
+
+    trc_name_thread("front end");
+
+    while((unit = thr_get_next_unit(ud)))
+        ud->func(unit, ud->crate);
+
+    return NULL;
+}
+
+void thr_compile_units(ShippingCrate *crate, Arraylist *units, thr_unit_function func)
+{
+    if(!units->count)
+        return;
+
+    int thrct = crate->threadct ? crate->threadct : threadct();
+
+    // Keep dumped code and IR readable
+    if(IN(global_args, "--dump-code") || IN(global_args, "--llvm"))
+        thrct = 1;
+
+    if(thrct > units->count)
+        thrct = units->count;
+
+    if(crate->verbose)
+        printf(BOLD "Compiling sources" DEFAULT " (%d threads)\n", thrct);
+
+    int next = 0;
+    UnitProcData ud = {crate, units, &next, func};
+
+    th_thread threads[thrct];
+
+    for(int i = 0; i < thrct; i++)
+        th_split_deep(threads[i], thr_unit_proc, &ud);
+
+    for(int i = 0; i < thrct; i++)
+        th_join(threads[i]);
+}
+
 void *thr_work_proc(void *data)
 {
     ThreadingBundle *bundle;
     ProcData *pd = data;
     ShippingCrate *crate = pd->crate;
 
+    trc_name_thread("codegen");
+
     int idx;
     int ct = 0;
-    while((bundle = thr_get_next_work(crate, &idx)))
+    while((bundle = thr_get_next_work(pd, &idx)))
     {
-        shp_optimize(bundle->module);
-        char *out = NULL;
-        shp_produce_assembly(bundle->module, bundle->filename, &out);
+        trc_set_file(bundle->filename);
+        if(bundle->cached_object)
+        {
+            char *object = bundle->cached_object;
+            if(IN(global_args, "-c"))
+            {
+                object = shp_switch_file_ext(bundle->filename, "o");
+                bc_copy_file(bundle->cached_object, object);
+            }
+
+            pd->outputfiles[idx] = object;
+            continue;
+        }
+
+        TraceSpan span = trc_begin("codegen");
+        double start = thr_getms();
+        int elided = bundle->optimized ? 0 : shp_optimize(bundle->module);
+        double optimized = thr_getms();
+
         char *object = NULL;
-        shp_produce_binary(bundle->filename, out, &object);
+        double emitted, assembled;
+        char *out = NULL;
+        if(IN(global_args, "-S"))
+        {
+            shp_produce_assembly(bundle->module, bundle->filename, &out);
+            emitted = assembled = thr_getms();
+        }
+        else if(IN(global_args, "--external-as"))
+        {
+            shp_produce_assembly(bundle->module, bundle->filename, &out);
+            emitted = thr_getms();
+            shp_produce_binary(bundle->filename, out, &object);
+            assembled = thr_getms();
+        }
+        else if(bundle->part_count)
+        {
+            shp_produce_partition(bundle->module, bundle->filename, &object);
+            emitted = assembled = thr_getms();
+        }
+        else
+        {
+            shp_produce_object(bundle->module, bundle->filename, &object);
+            emitted = assembled = thr_getms();
+        }
+
+        trc_end(&span);
+        pd->optimize_ms += optimized - start;
+        pd->emit_ms += emitted - optimized;
+        pd->assemble_ms += assembled - emitted;
+
+        if(crate->verbose)
+        {
+            char name[strlen(bundle->filename) + 30];
+            if(bundle->part_count)
+                sprintf(name, "%s, unit %d/%d", bundle->filename, bundle->part, bundle->part_count);
+            else
+                strcpy(name, bundle->filename);
+
+            printf(BLUE "Module (%s)" DEFAULT " -- optimize %.2f ms, emit %.2f ms, assemble %.2f ms\n",
+                   name, optimized - start, emitted - optimized, assembled - emitted);
+            printf(BLUE "Module (%s)" DEFAULT " -- %d reference counting operations elided\n",
+                   name, elided);
+        }
+
+        if(object && bundle->cache_key)
+            bc_store(crate->cache_dir, bundle->cache_key, object);
 
         pd->outputfiles[idx] = object;
         ct += 1;
     }
 
+    trc_set_file(NULL);
+
+    th_lock(time_lock);
+    crate->optimize_ms += pd->optimize_ms;
+    crate->emit_ms += pd->emit_ms;
+    crate->assemble_ms += pd->assemble_ms;
+    th_unlock(time_lock);
+
     if(crate->verbose)
         printf(BLUE "Thread (%d) complete" DEFAULT " -- compiled %d modules\n", pd->thread_num, ct);
 
@@ -184,15 +588,65 @@ void *thr_work_proc(void *data)
     return NULL;
 }
 
-void thr_produce_machine_code(ShippingCrate *crate)
+// Puts the objects of each module on the crate in source order. Partitions
+// are linked back into one object when it has to outlive the build
+static void thr_collect_objects(ShippingCrate *crate, Arraylist *modules, int *parts, char **outputfiles)
 {
-    crate->widex = 0;
+    int i, next = 0;
+    for(i = 0; i < modules->count; i++)
+    {
+        ThreadingBundle *bundle = modules->items[i];
+        char **objects = outputfiles + next;
+        int count = parts[i] ? parts[i] : 1;
+        next += count;
+
+        if(parts[i] && (IN(global_args, "-c") || bundle->cache_key))
+        {
+            char *object = NULL;
+            shp_combine_objects(bundle->filename, objects, count, &object);
 
+            if(bundle->cache_key)
+                bc_store(crate->cache_dir, bundle->cache_key, object);
+
+            arr_append(&crate->object_files, object);
+            continue;
+        }
+
+        int j;
+        for(j = 0; j < count; j++)
+            if(objects[j])
+                arr_append(&crate->object_files, objects[j]);
+    }
+}
+
+void thr_produce_machine_code(ShippingCrate *crate)
+{
     int thrct = crate->threadct ? crate->threadct : threadct();
 
+    Arraylist modules = crate->work;
+    int parts[modules.count + 1];
+
+    crate->work = arr_create(modules.count + 1);
+    for(int i = 0; i < modules.count; i++)
+    {
+        parts[i] = thr_split_bundle(crate, modules.items[i], &crate->work, thrct);
+        if(!parts[i])
+            arr_append(&crate->work, modules.items[i]);
+    }
+
     if(thrct > crate->work.count)
         thrct = crate->work.count;
 
+    if(!thrct)
+    {
+        arr_free(&crate->work);
+        crate->work = modules;
+        return;
+    }
+
+    Scheduler sched;
+    thr_seed_scheduler(&sched, crate, thrct);
+
     if(crate->verbose)
         printf(BOLD "Generating machine code" DEFAULT " (%d threads)\n", thrct);
 
@@ -204,15 +658,32 @@ void thr_produce_machine_code(ShippingCrate *crate)
         ProcData *pd = malloc(sizeof(ProcData));
         pd->thread_num = i + 1;
         pd->crate = crate;
+        pd->sched = &sched;
         pd->outputfiles = outputfiles;
+        pd->optimize_ms = pd->emit_ms = pd->assemble_ms = 0;
         th_split(threads[i], thr_work_proc, pd);
     }
 
     for(int i = 0; i < thrct; i++)
         th_join(threads[i]);
 
+    thr_free_scheduler(&sched);
+
+    thr_collect_objects(crate, &modules, parts, outputfiles);
+
     for(int i = 0; i < crate->work.count; i++)
-        arr_append(&crate->object_files, outputfiles[i]);
+    {
+        ThreadingBundle *bundle = crate->work.items[i];
+        if(bundle->part_count)
+            free(bundle);
+    }
+
+    arr_free(&crate->work);
+    crate->work = modules;
+
+    if(crate->verbose)
+        printf(BOLD "Code generation phases" DEFAULT " -- optimize %.2f ms, emit %.2f ms, assemble %.2f ms (summed over threads)\n",
+               crate->optimize_ms, crate->emit_ms, crate->assemble_ms);
 }
 
 char *thr_temp_object_file(char *filename)
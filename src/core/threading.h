@@ -12,19 +12,33 @@
 #include "llvm_headers.h"
 #include "arraylist.h"
 #include "shipping.h"
+#include "compunit.h"
 
 typedef struct {
     LLVMModuleRef module;
     LLVMContextRef context;
     char *filename;
     char *assemblyname;
+
+    char *cache_key;
+    char *cached_object;
+
+    // Which of part_count partitions of filename this is (--codegen-units)
+    int part;
+    int part_count;
+
+    // Already run through the optimizer (--lto)
+    int optimized;
 } ThreadingBundle;
 
+typedef void (*thr_unit_function)(CompilationUnit *unit, ShippingCrate *crate);
+
 int thr_request_number();
 
 ThreadingBundle *thr_create_bundle(LLVMModuleRef module, LLVMContextRef context, char *filename);
 void thr_init();
 void thr_teardown();
+void thr_compile_units(ShippingCrate *crate, Arraylist *units, thr_unit_function func);
 void thr_produce_machine_code(ShippingCrate *crate);
 void thr_populate_pass_manager(LLVMPassManagerBuilderRef pbr, LLVMPassManagerRef pm);
 
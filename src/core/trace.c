@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "trace.h"
+#include "arraylist.h"
+#include "colors.h"
+#include "config.h"
+
+#ifdef HAS_PTHREAD
+#include <pthread.h>
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+#define trc_lock() pthread_mutex_lock(&trace_lock)
+#define trc_unlock() pthread_mutex_unlock(&trace_lock)
+#else
+#define trc_lock()
+#define trc_unlock()
+#endif
+
+typedef struct {
+    const char *phase;
+    const char *file;
+    int tid;
+    double start;
+    double dur;
+} TraceEvent;
+
+static int enabled = 0;
+static int report = 0;
+static const char *trace_file = NULL;
+static double origin;
+
+static TraceEvent *events = NULL;
+static int event_count = 0;
+static int event_alloc = 0;
+
+// Thread names, indexed by trace thread id
+static Arraylist threads;
+
+static EGL_THREAD_LOCAL int thread_id = -1;
+static EGL_THREAD_LOCAL const char *thread_file = NULL;
+
+// Microseconds, which is what trace viewers expect
+static double trc_now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000.0 + tv.tv_usec - origin;
+}
+
+void trc_init(int rep, const char *file)
+{
+    report = rep;
+    trace_file = file;
+    enabled = report || trace_file;
+
+    if(!enabled)
+        return;
+
+    origin = 0;
+    origin = trc_now();
+    threads = arr_create(8);
+
+    trc_name_thread("main");
+}
+
+// Ids are handed out in the order threads first show up, and every worker
+// gets a fresh one, so the timelines of successive pools stay apart
+void trc_name_thread(const char *role)
+{
+    if(!enabled)
+        return;
+
+    trc_lock();
+    thread_id = threads.count;
+
+    char *name = malloc(strlen(role) + 20);
+    if(thread_id)
+        sprintf(name, "%s (%d)", role, thread_id);
+    else
+        strcpy(name, role);
+
+    arr_append(&threads, name);
+    trc_unlock();
+}
+
+void trc_set_file(const char *file)
+{
+    thread_file = file;
+}
+
+TraceSpan trc_begin(const char *phase)
+{
+    TraceSpan span = {phase, enabled ? trc_now() : 0};
+    return span;
+}
+
+void trc_end(TraceSpan *span)
+{
+    if(!enabled)
+        return;
+
+    double end = trc_now();
+    if(thread_id < 0)
+        trc_name_thread("thread");
+
+    trc_lock();
+    if(event_count == event_alloc)
+    {
+        event_alloc = event_alloc ? event_alloc * 2 : 256;
+        events = realloc(events, event_alloc * sizeof(TraceEvent));
+    }
+
+    TraceEvent *e = events + event_count++;
+    e->phase = span->phase;
+    e->file = thread_file;
+    e->tid = thread_id;
+    e->start = span->start;
+    e->dur = end - span->start;
+    trc_unlock();
+}
+
+static void trc_write_str(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for(; *str; str++)
+    {
+        if(*str == '"' || *str == '\\')
+            fputc('\\', f);
+        if((unsigned char)*str < 0x20)
+            fprintf(f, "\\u%04x", *str);
+        else
+            fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+// Chrome trace event format: one complete ("X") event per span, plus
+// metadata naming each thread
+static void trc_write_trace()
+{
+    FILE *f = fopen(trace_file, "w");
+    if(!f)
+    {
+        warn(-1, "Could not write trace to %s", trace_file);
+        return;
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+
+    int i;
+    for(i = 0; i < threads.count; i++)
+    {
+        fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", i);
+        trc_write_str(f, arr_get(&threads, i));
+        fprintf(f, "}},\n");
+    }
+
+    for(i = 0; i < event_count; i++)
+    {
+        TraceEvent *e = events + i;
+        fprintf(f, "{\"name\":");
+        trc_write_str(f, e->phase);
+        fprintf(f, ",\"cat\":\"build\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f",
+                e->tid, e->start, e->dur);
+        if(e->file)
+        {
+            fprintf(f, ",\"args\":{\"file\":");
+            trc_write_str(f, e->file);
+            fprintf(f, "}");
+        }
+        fprintf(f, "}%s\n", i == event_count - 1 ? "" : ",");
+    }
+
+    fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(f);
+}
+
+static int trc_same(const char *a, const char *b)
+{
+    return a == b || (a && b && !strcmp(a, b));
+}
+
+// Phases are listed in the order they first ran
+static void trc_print_phases(const char *file, int by_file)
+{
+    int i, j;
+    for(i = 0; i < event_count; i++)
+    {
+        TraceEvent *e = events + i;
+        if(by_file && !trc_same(e->file, file))
+            continue;
+
+        for(j = 0; j < i; j++)
+            if(trc_same(events[j].phase, e->phase) && (!by_file || trc_same(events[j].file, file)))
+                break;
+        if(j < i)
+            continue;
+
+        double total = 0;
+        int count = 0;
+        for(j = i; j < event_count; j++)
+        {
+            if(!trc_same(events[j].phase, e->phase) || (by_file && !trc_same(events[j].file, file)))
+                continue;
+            total += events[j].dur;
+            count++;
+        }
+
+        if(by_file)
+            printf("    %-16s %10.2f ms\n", e->phase, total / 1000);
+        else
+            printf("  %-18s %10.2f ms %8d\n", e->phase, total / 1000, count);
+    }
+}
+
+static void trc_print_report()
+{
+    printf(BOLD "Time report" DEFAULT " (summed over threads)\n");
+    printf("  %-18s %13s %8s\n", "phase", "total", "count");
+    trc_print_phases(NULL, 0);
+
+    int i, j;
+    for(i = 0; i < event_count; i++)
+    {
+        const char *file = events[i].file;
+        if(!file)
+            continue;
+
+        for(j = 0; j < i; j++)
+            if(trc_same(events[j].file, file))
+                break;
+        if(j < i)
+            continue;
+
+        printf(BLUE "  %s" DEFAULT "\n", file);
+        trc_print_phases(file, 1);
+    }
+}
+
+void trc_finish()
+{
+    if(!enabled)
+        return;
+
+    if(report)
+        trc_print_report();
+    if(trace_file)
+        trc_write_trace();
+
+    int i;
+    for(i = 0; i < threads.count; i++)
+        free(arr_get(&threads, i));
+    arr_free(&threads);
+
+    free(events);
+    events = NULL;
+    event_count = event_alloc = 0;
+    enabled = 0;
+}
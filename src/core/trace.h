@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+// Timing of the build phases for --time-report and --trace=<file>. Spans
+// are recorded against the file the calling thread is working on (see
+// trc_set_file) and cost nothing beyond a branch while tracing is off.
+typedef struct {
+    const char *phase;
+    double start;
+} TraceSpan;
+
+void trc_init(int report, const char *trace_file);
+void trc_finish();
+
+void trc_name_thread(const char *role);
+void trc_set_file(const char *file);
+
+TraceSpan trc_begin(const char *phase);
+void trc_end(TraceSpan *span);
+
+#endif
@@ -14,6 +14,7 @@
 #include "utils.h"
 #include "config.h"
 #include "stringbuilder.h"
+#include "intern.h"
 
 #define TTEST(t, targ, out) if(!strcmp(t, targ)) return ett_base_type(out)
 #define ETEST(t, a, b) if(a == b) return t
@@ -22,30 +23,65 @@
 
 extern int pipe_is_type(char *);
 
-LLVMModuleRef the_module = NULL;
-LLVMTargetDataRef etTargetData = NULL;
+EGL_THREAD_LOCAL LLVMModuleRef the_module = NULL;
+EGL_THREAD_LOCAL LLVMTargetDataRef etTargetData = NULL;
 
 void ty_method_free(void *k, void *v, void *d);
 void ty_struct_def_free(void *k, void *v, void *d);
 static size_t ty_size_of_type(EagleComplexType *type);
+static int ty_is_stable(EagleComplexType *type);
+
+static EGL_THREAD_LOCAL Mempool type_mempool;
+static EGL_THREAD_LOCAL Mempool list_mempool;
+
+static EGL_THREAD_LOCAL Hashtable name_table;
+static EGL_THREAD_LOCAL Hashtable typedef_table;
+static EGL_THREAD_LOCAL Hashtable enum_table;
+static EGL_THREAD_LOCAL Hashtable struct_table;
+static EGL_THREAD_LOCAL Hashtable types_table;
+static EGL_THREAD_LOCAL Hashtable counted_table;
+static EGL_THREAD_LOCAL Hashtable method_table;
+static EGL_THREAD_LOCAL Hashtable type_named_table;
+static EGL_THREAD_LOCAL Hashtable enum_named_table;
+static EGL_THREAD_LOCAL Hashtable init_table;
+static EGL_THREAD_LOCAL Hashtable interface_table;
+static EGL_THREAD_LOCAL Hashtable generic_ident_table;
+static EGL_THREAD_LOCAL LLVMTypeRef indirect_struct_type = NULL;
+static EGL_THREAD_LOCAL LLVMTypeRef itable_entry_type = NULL;
+static EGL_THREAD_LOCAL LLVMTypeRef counted_header_type = NULL;
+static EGL_THREAD_LOCAL LLVMTypeRef type_descriptor_type = NULL;
+static EGL_THREAD_LOCAL LLVMTypeRef generator_type = NULL;
+
+// Pointer, array, function and generator types are hash-consed: the
+// constructors below look the type up by its kind, its (already interned)
+// component pointers and its flags, so that building the same type twice
+// yields the same object. Interned types must never be modified; code that
+// needs a type to mutate takes a private copy with ett_copy.
+//
+// The info block caches what would otherwise be recomputed on every use.
+// Caches are only filled in once the type is known to be stable, that is,
+// once it has a normal form (see ty_norm): generic placeholders are
+// overwritten for every instantiation and typedefs are filled in after the
+// types that name them are built, so anything depending on either is
+// always recomputed.
+struct EagleTypeInfo {
+    EagleComplexType *norm; // Interned representative under ett_are_same
+    int normalized;
+    LLVMTypeRef llvm;
+    char *mangled;
+    int size;
+};
+
+#define NORM_UNKNOWN 0
+#define NORM_DONE 1
+#define NORM_NONE 2
+
+static EGL_THREAD_LOCAL Hashtable intern_table;
+static EGL_THREAD_LOCAL Hashtable placeholder_table;
 
-static Mempool type_mempool;
-static Mempool list_mempool;
-
-static Hashtable name_table;
-static Hashtable typedef_table;
-static Hashtable enum_table;
-static Hashtable struct_table;
-static Hashtable types_table;
-static Hashtable counted_table;
-static Hashtable method_table;
-static Hashtable type_named_table;
-static Hashtable enum_named_table;
-static Hashtable init_table;
-static Hashtable interface_table;
-static Hashtable generic_ident_table;
-static LLVMTypeRef indirect_struct_type = NULL;
-static LLVMTypeRef generator_type = NULL;
+// All interfaces and all generators compare equal under ett_are_same
+static EagleComplexType any_interface = {ETInterface, NULL};
+static EagleComplexType any_generator = {ETGenerator, NULL};
 
 void list_mempool_free(void *datum)
 {
@@ -56,7 +92,6 @@ void list_mempool_free(void *datum)
 void ty_prepare()
 {
     name_table = hst_create();
-    name_table.duplicate_keys = 1;
 
     typedef_table = hst_create();
     typedef_table.duplicate_keys = 1;
@@ -91,6 +126,9 @@ void ty_prepare()
     generic_ident_table = hst_create();
     generic_ident_table.duplicate_keys = 1;
 
+    intern_table = hst_create();
+    placeholder_table = hst_create();
+
     type_mempool = pool_create();
     list_mempool = pool_create();
     list_mempool.free_func = list_mempool_free;
@@ -119,6 +157,8 @@ void ty_teardown()
     hst_free(&method_table);
     hst_free(&init_table);
     hst_free(&generic_ident_table);
+    hst_free(&placeholder_table);
+    hst_free(&intern_table);
 
     hst_free(&interface_table);
 
@@ -128,6 +168,9 @@ void ty_teardown()
     pool_drain(&type_mempool);
 
     indirect_struct_type = NULL;
+    itable_entry_type = NULL;
+    counted_header_type = NULL;
+    type_descriptor_type = NULL;
     generator_type = NULL;
 }
 
@@ -148,7 +191,7 @@ EagleComplexType *et_parse_string(char *text)
     TTEST(text, "double", ETDouble);
     TTEST(text, "void", ETVoid);
 
-    if(ty_is_name(text))
+    if(ty_is_name(in_intern(text)))
     {
         void *type = hst_get(&typedef_table, text, NULL, NULL);
         if(type)
@@ -240,7 +283,7 @@ LLVMValueRef ett_default_value(EagleComplexType *type)
     }
 }
 
-LLVMTypeRef ett_llvm_type(EagleComplexType *type)
+static LLVMTypeRef ett_llvm_type_uncached(EagleComplexType *type)
 {
     switch(type->type)
     {
@@ -303,19 +346,13 @@ LLVMTypeRef ett_llvm_type(EagleComplexType *type)
             EaglePointerType *pt = (EaglePointerType *)type;
             if(pt->counted || pt->weak)
             {
-                LLVMTypeRef ptmp[2];
-                ptmp[0] = LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0);
-                ptmp[1] = LLVMInt1TypeInContext(utl_get_current_context());
-
-                LLVMTypeRef tys[6];
-                tys[0] = LLVMInt64TypeInContext(utl_get_current_context());
-                tys[1] = LLVMInt16TypeInContext(utl_get_current_context());
-                tys[2] = LLVMInt16TypeInContext(utl_get_current_context());
-                tys[3] = LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0);
-                tys[4] = LLVMPointerType(LLVMFunctionType(LLVMVoidTypeInContext(utl_get_current_context()), ptmp, 2, 0), 0);
-                tys[5] = ett_llvm_type(pt->to);
-
-                return LLVMPointerType(ty_get_counted(LLVMStructTypeInContext(utl_get_current_context(), tys, 6, 0)), 0);
+                LLVMTypeRef tys[4];
+                tys[0] = LLVMInt32TypeInContext(utl_get_current_context());
+                tys[1] = LLVMInt32TypeInContext(utl_get_current_context());
+                tys[2] = LLVMPointerType(ty_type_descriptor(), 0);
+                tys[3] = ett_llvm_type(pt->to);
+
+                return LLVMPointerType(ty_get_counted(LLVMStructTypeInContext(utl_get_current_context(), tys, 4, 0)), 0);
             }
             return LLVMPointerType(ett_llvm_type(((EaglePointerType *)type)->to), 0);
         }
@@ -351,6 +388,19 @@ LLVMTypeRef ett_llvm_type(EagleComplexType *type)
     }
 }
 
+LLVMTypeRef ett_llvm_type(EagleComplexType *type)
+{
+    struct EagleTypeInfo *info = type->info;
+    if(info && info->llvm)
+        return info->llvm;
+
+    LLVMTypeRef out = ett_llvm_type_uncached(type);
+    if(out && ty_is_stable(type))
+        info->llvm = out;
+
+    return out;
+}
+
 /*
 EagleBasicType et_eagle_type(LLVMTypeRef ty)
 {
@@ -363,7 +413,7 @@ EagleBasicType et_eagle_type(LLVMTypeRef ty)
 }
 */
 
-#define TT(t) {ET ## t }
+#define TT(t) {ET ## t, NULL}
 static EagleComplexType base_types[] = {
     TT(None),
     TT(Any),
@@ -395,59 +445,285 @@ EagleComplexType *ett_base_type(EagleBasicType type)
     return &base_types[type];
 }
 
-EagleComplexType *ett_pointer_type(EagleComplexType *to)
+static long ty_ptr_hash(void *k, void *d)
 {
-    EaglePointerType *ett = malloc(sizeof(EaglePointerType));
-    ett->type = ETPointer;
-    ett->to = to;
-    ett->counted = 0;
-    ett->weak = 0;
-    ett->closed = 0;
+    return (long)k;
+}
 
-    pool_add(&type_mempool, ett);
+static int ty_ptr_equ(void *k, void *d)
+{
+    return k == d;
+}
 
-    return (EagleComplexType *)ett;
+static long ty_intern_hash(void *k, void *d)
+{
+    EagleComplexType *t = k;
+    unsigned long h = t->type;
+
+    switch(t->type)
+    {
+        case ETPointer:
+        {
+            EaglePointerType *pt = k;
+            h = h * 31 + (uintptr_t)pt->to;
+            h = h * 31 + (pt->counted | pt->weak << 1 | pt->closed << 2);
+            break;
+        }
+        case ETArray:
+        {
+            EagleArrayType *at = k;
+            h = h * 31 + (uintptr_t)at->of;
+            h = h * 31 + (unsigned)at->ct;
+            break;
+        }
+        case ETFunction:
+        {
+            EagleFunctionType *ft = k;
+            h = h * 31 + (uintptr_t)ft->retType;
+            for(int i = 0; i < ft->pct; i++)
+                h = h * 31 + (uintptr_t)ft->params[i];
+            h = h * 31 + (ft->pct << 8 | ft->closure << 3 | ft->variadic << 2 | ft->gen);
+            break;
+        }
+        case ETGenerator:
+            h = h * 31 + (uintptr_t)((EagleGenType *)k)->ytype;
+            break;
+        default:
+            break;
+    }
+
+    return (long)h;
 }
 
-EagleComplexType *ett_array_type(EagleComplexType *of, int ct)
+static int ty_intern_equ(void *k, void *d)
+{
+    EagleComplexType *l = k;
+    EagleComplexType *r = d;
+    if(l->type != r->type)
+        return 0;
+
+    switch(l->type)
+    {
+        case ETPointer:
+        {
+            EaglePointerType *pl = k;
+            EaglePointerType *pr = d;
+            return pl->to == pr->to && pl->counted == pr->counted &&
+                   pl->weak == pr->weak && pl->closed == pr->closed;
+        }
+        case ETArray:
+        {
+            EagleArrayType *al = k;
+            EagleArrayType *ar = d;
+            return al->of == ar->of && al->ct == ar->ct;
+        }
+        case ETFunction:
+        {
+            EagleFunctionType *fl = k;
+            EagleFunctionType *fr = d;
+            if(fl->retType != fr->retType || fl->pct != fr->pct || fl->closure != fr->closure ||
+               fl->variadic != fr->variadic || fl->gen != fr->gen)
+                return 0;
+
+            return !fl->pct || !memcmp(fl->params, fr->params, sizeof(EagleComplexType *) * fl->pct);
+        }
+        case ETGenerator:
+            return ((EagleGenType *)k)->ytype == ((EagleGenType *)d)->ytype;
+        default:
+            return 0;
+    }
+}
+
+// Returns the interned equivalent of the stack allocated prototype
+static EagleComplexType *ty_intern(EagleComplexType *proto, size_t size)
 {
-    EagleArrayType *ett = malloc(sizeof(EagleArrayType));
-    ett->type = ETArray;
-    ett->of = of;
-    ett->ct = ct;
+    EagleComplexType *ett = hst_get(&intern_table, proto, ty_intern_hash, ty_intern_equ);
+    if(ett)
+        return ett;
+
+    ett = malloc(size);
+    memcpy(ett, proto, size);
+    ett->info = calloc(1, sizeof(struct EagleTypeInfo));
 
+    if(ett->type == ETFunction)
+    {
+        EagleFunctionType *ft = (EagleFunctionType *)ett;
+        ft->params = malloc(sizeof(EagleComplexType *) * ft->pct);
+        memcpy(ft->params, ((EagleFunctionType *)proto)->params, sizeof(EagleComplexType *) * ft->pct);
+        pool_add(&type_mempool, ft->params);
+    }
+
+    pool_add(&type_mempool, ett->info);
     pool_add(&type_mempool, ett);
+    hst_put(&intern_table, ett, ett, ty_intern_hash, ty_intern_equ);
 
-    return (EagleComplexType *)ett;
+    return ett;
+}
+
+EagleComplexType *ett_pointer_type(EagleComplexType *to)
+{
+    return ett_pointer_type_ex(to, 0, 0, 0);
+}
+
+EagleComplexType *ett_pointer_type_ex(EagleComplexType *to, int counted, int weak, int closed)
+{
+    EaglePointerType ett;
+    ett.type = ETPointer;
+    ett.info = NULL;
+    ett.to = to;
+    ett.counted = counted;
+    ett.weak = weak;
+    ett.closed = closed;
+
+    return ty_intern((EagleComplexType *)&ett, sizeof(ett));
+}
+
+EagleComplexType *ett_array_type(EagleComplexType *of, int ct)
+{
+    EagleArrayType ett;
+    ett.type = ETArray;
+    ett.info = NULL;
+    ett.of = of;
+    ett.ct = ct;
+
+    return ty_intern((EagleComplexType *)&ett, sizeof(ett));
 }
 
 EagleComplexType *ett_function_type(EagleComplexType *retVal, EagleComplexType **params, int pct)
 {
-    EagleFunctionType *ett = malloc(sizeof(EagleFunctionType));
-    ett->type = ETFunction;
-    ett->retType = retVal;
-    ett->params = malloc(sizeof(EagleComplexType *) * pct);
-    memcpy(ett->params, params, sizeof(EagleComplexType *) * pct);
-    ett->pct = pct;
-    ett->variadic = 0;
-    ett->closure = NO_CLOSURE;
-    ett->gen = 0;
+    return ett_function_type_ex(retVal, params, pct, NO_CLOSURE, 0, 0);
+}
 
-    pool_add(&type_mempool, ett);
-    pool_add(&type_mempool, ett->params);
+EagleComplexType *ett_function_type_ex(EagleComplexType *retVal, EagleComplexType **params, int pct, int closure, int variadic, int gen)
+{
+    EagleFunctionType ett;
+    ett.type = ETFunction;
+    ett.info = NULL;
+    ett.retType = retVal;
+    ett.params = params;
+    ett.pct = pct;
+    ett.variadic = variadic;
+    ett.closure = closure;
+    ett.gen = gen;
 
-    return (EagleComplexType *)ett;
+    return ty_intern((EagleComplexType *)&ett, sizeof(ett));
 }
 
 EagleComplexType *ett_gen_type(EagleComplexType *ytype)
 {
-    EagleGenType *ett = malloc(sizeof(EagleGenType));
-    ett->type = ETGenerator;
-    ett->ytype = ytype;
+    EagleGenType ett;
+    ett.type = ETGenerator;
+    ett.info = NULL;
+    ett.ytype = ytype;
 
-    pool_add(&type_mempool, ett);
+    return ty_intern((EagleComplexType *)&ett, sizeof(ett));
+}
 
-    return (EagleComplexType *)ett;
+static EagleComplexType *ty_norm_interned(EagleComplexType *t, int *fixed);
+
+// The representative of every type ett_are_same considers equal to t, or
+// NULL if there is none. *fixed is cleared when the answer may change later
+static EagleComplexType *ty_norm(EagleComplexType *t, int *fixed)
+{
+    if(hst_contains_key(&placeholder_table, t, ty_ptr_hash, ty_ptr_equ))
+        return NULL;
+
+    switch(t->type)
+    {
+        case ETGeneric:
+            return NULL;
+        case ETNone:
+            // A typedef that has not been filled in yet
+            *fixed = 0;
+            return NULL;
+        case ETStruct:
+        case ETClass:
+        case ETEnum:
+        {
+            Hashtable *named = t->type == ETEnum ? &enum_named_table : &type_named_table;
+            char *name = t->type == ETEnum ? ((EagleEnumType *)t)->name : ((EagleStructType *)t)->name;
+
+            EagleComplexType *et = hst_get(named, name, NULL, NULL);
+            if(!et)
+                *fixed = 0;
+            return et;
+        }
+        case ETInterface:
+            return &any_interface;
+        case ETGenerator:
+            return &any_generator;
+        case ETPointer:
+        case ETArray:
+        case ETFunction:
+            return ty_norm_interned(t, fixed);
+        default:
+            return ett_base_type(t->type);
+    }
+}
+
+static EagleComplexType *ty_norm_interned(EagleComplexType *t, int *fixed)
+{
+    struct EagleTypeInfo *info = t->info;
+    if(!info || info->normalized == NORM_NONE)
+        return NULL;
+    if(info->normalized == NORM_DONE)
+        return info->norm;
+
+    int stable = 1;
+    EagleComplexType *norm = NULL;
+    switch(t->type)
+    {
+        case ETPointer:
+        {
+            EaglePointerType *pt = (EaglePointerType *)t;
+            EagleComplexType *to = ty_norm(pt->to, &stable);
+            if(to)
+                norm = ett_pointer_type_ex(to, pt->counted || pt->weak, 0, 0);
+            break;
+        }
+        case ETArray:
+        {
+            EagleArrayType *at = (EagleArrayType *)t;
+            EagleComplexType *of = ty_norm(at->of, &stable);
+            if(of)
+                norm = ett_array_type(of, at->ct);
+            break;
+        }
+        case ETFunction:
+        {
+            EagleFunctionType *ft = (EagleFunctionType *)t;
+            EagleComplexType *params[ft->pct + 1];
+            EagleComplexType *ret = ty_norm(ft->retType, &stable);
+            for(int i = 0; i < ft->pct && ret; i++)
+                if(!(params[i] = ty_norm(ft->params[i], &stable)))
+                    ret = NULL;
+
+            if(ret)
+                norm = ett_function_type_ex(ret, params, ft->pct, ft->closure != NO_CLOSURE, 0, ft->gen);
+            break;
+        }
+        default:
+            break;
+    }
+
+    if(norm)
+    {
+        info->norm = norm;
+        info->normalized = NORM_DONE;
+    }
+    else if(stable)
+        info->normalized = NORM_NONE;
+    else
+        *fixed = 0;
+
+    return norm;
+}
+
+// Whether the cached properties of an interned type may be kept
+static int ty_is_stable(EagleComplexType *t)
+{
+    int fixed = 1;
+    return t->info && ty_norm_interned(t, &fixed);
 }
 
 EagleComplexType *ett_struct_type(char *name)
@@ -597,16 +873,19 @@ EagleComplexType *ett_deep_copy(EagleComplexType *type)
 }
 */
 
+// Private copies are never interned, so they may be modified
 EagleComplexType *ett_copy(EagleComplexType *type)
 {
     EagleComplexType *output = malloc(ty_size_of_type(type));
     pool_add(&type_mempool, output);
     memcpy(output, type, ty_size_of_type(type));
+    output->info = NULL;
 
     if(output->type == ETFunction)
     {
         EagleFunctionType *ft = (EagleFunctionType *)output;
         ft->params = malloc(ft->pct * sizeof(EagleComplexType *));
+        memcpy(ft->params, ((EagleFunctionType *)type)->params, ft->pct * sizeof(EagleComplexType *));
         pool_add(&type_mempool, ft->params);
     }
 
@@ -661,6 +940,18 @@ EagleBasicType ett_get_base_type(EagleComplexType *type)
 
 int ett_are_same(EagleComplexType *left, EagleComplexType *right)
 {
+    if(left == right)
+        return 1;
+
+    if(left->info && right->info)
+    {
+        int fixed = 1;
+        EagleComplexType *nl = ty_norm_interned(left, &fixed);
+        EagleComplexType *nr = nl ? ty_norm_interned(right, &fixed) : NULL;
+        if(nl && nr)
+            return nl == nr;
+    }
+
     if(left->type != right->type)
     {
         if(left->type == ETGeneric || right->type == ETGeneric)
@@ -734,9 +1025,9 @@ int ett_are_same(EagleComplexType *left, EagleComplexType *right)
 
 #define TTJOIN(t) ET ## t
 #define NAME_BASIC(type) case TTJOIN(type):\
-    return strdup("__" #type "__")
+    return (char *)"__" #type "__"
 
-char *ett_unique_type_name(EagleComplexType *t)
+static char *ett_mangle_type(EagleComplexType *t)
 {
     switch(t->type)
     {
@@ -787,7 +1078,7 @@ char *ett_unique_type_name(EagleComplexType *t)
         case ETStruct:
         {
             EagleStructType *st = (EagleStructType *)t;
-            return strdup(st->name);
+            return st->name;
         }
 
         case ETInterface:
@@ -812,16 +1103,12 @@ char *ett_unique_type_name(EagleComplexType *t)
             sb_append(&sb, "fn_");
             for(int i = 0; i < ft->pct; i++)
             {
-                char *p = ett_unique_type_name(ft->params[i]);
-                sb_append(&sb, p);
-                free(p);
+                sb_append(&sb, ett_unique_type_name(ft->params[i]));
             }
 
             if(ft->retType->type != ETVoid)
             {
-                char *p = ett_unique_type_name(ft->retType);
-                sb_append(&sb, p);
-                free(p);
+                sb_append(&sb, ett_unique_type_name(ft->retType));
             }
             else
             {
@@ -835,6 +1122,33 @@ char *ett_unique_type_name(EagleComplexType *t)
     }
 }
 
+// The name belongs to the type table and must not be freed
+char *ett_unique_type_name(EagleComplexType *t)
+{
+    struct EagleTypeInfo *info = t->info;
+    if(info && info->mangled)
+        return info->mangled;
+
+    char *out = ett_mangle_type(t);
+    switch(t->type)
+    {
+        case ETPointer:
+        case ETArray:
+        case ETGenerator:
+        case ETInterface:
+        case ETFunction:
+            pool_add(&type_mempool, out);
+            break;
+        default:
+            return out;
+    }
+
+    if(ty_is_stable(t))
+        info->mangled = out;
+
+    return out;
+}
+
 int ett_pointer_depth(EagleComplexType *t)
 {
     EaglePointerType *pt = (EaglePointerType *)t;
@@ -845,7 +1159,15 @@ int ett_pointer_depth(EagleComplexType *t)
 
 int ett_size_of_type(EagleComplexType *t)
 {
-    return LLVMStoreSizeOfType(etTargetData, ett_llvm_type(t));
+    struct EagleTypeInfo *info = t->info;
+    if(info && info->size)
+        return info->size;
+
+    int size = LLVMStoreSizeOfType(etTargetData, ett_llvm_type(t));
+    if(ty_is_stable(t))
+        info->size = size;
+
+    return size;
 }
 
 LLVMTypeRef ty_class_indirect()
@@ -859,13 +1181,33 @@ LLVMTypeRef ty_class_indirect()
         LLVMInt32TypeInContext(utl_get_current_context()),
         LLVMPointerType(LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0), 0),
         LLVMPointerType(LLVMInt64TypeInContext(utl_get_current_context()), 0),
-        LLVMPointerType(LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0), 0)
+        LLVMPointerType(LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0), 0),
+        LLVMInt64TypeInContext(utl_get_current_context()),
+        LLVMPointerType(ty_class_itable_entry(), 0)
     };
 
-    LLVMStructSetBody(indirect_struct_type, tys, 4, 0);
+    LLVMStructSetBody(indirect_struct_type, tys, 6, 0);
     return indirect_struct_type;
 }
 
+// One slot of a class's itable: the id of the interface living in the
+// slot and a pointer to that interface's block of methods
+LLVMTypeRef ty_class_itable_entry()
+{
+    if(itable_entry_type)
+        return itable_entry_type;
+
+    itable_entry_type = LLVMStructCreateNamed(utl_get_current_context(), "__egl_itable_entry");
+
+    LLVMTypeRef tys[] = {
+        LLVMInt64TypeInContext(utl_get_current_context()),
+        LLVMPointerType(LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0), 0)
+    };
+
+    LLVMStructSetBody(itable_entry_type, tys, 2, 0);
+    return itable_entry_type;
+}
+
 void ett_debug_print(EagleComplexType *t)
 {
     switch(t->type)
@@ -950,12 +1292,14 @@ int ett_qualifies_as_generic(EagleComplexType *type)
 
 void ty_add_name(char *name)
 {
-    hst_put(&name_table, name, PLACEHOLDER, NULL, NULL);
+    hst_put(&name_table, in_intern(name), PLACEHOLDER, in_hash, in_equ);
 }
 
+// The lexer asks this for every identifier, so the name must already be
+// interned
 int ty_is_name(char *name)
 {
-    return (int)(uintptr_t)hst_get(&name_table, name, NULL, NULL);
+    return (int)(uintptr_t)hst_get(&name_table, name, in_hash, in_equ);
 }
 
 int ty_is_class(char *name)
@@ -1061,7 +1405,8 @@ void ty_add_enum_item(char *name, char *item, long val)
 
 void ty_register_typedef(char *name)
 {
-    void *tag = malloc(ty_type_max_size());
+    // Reads as ETNone until the typedef is filled in
+    void *tag = calloc(1, ty_type_max_size());
     hst_put(&typedef_table, name, tag, NULL, NULL);
 }
 
@@ -1123,6 +1468,21 @@ int ty_interface_count(char *name)
     return (int)names->count;
 }
 
+// Interface ids are derived from the interface name alone, so every
+// module agrees on them without any link-time coordination
+unsigned long ty_interface_id(char *name)
+{
+    unsigned long hash = 14695981039346656037UL;
+    for(; *name; name++)
+    {
+        hash ^= (unsigned char)*name;
+        hash *= 1099511628211UL;
+    }
+
+    // Zero marks an empty itable slot
+    return hash ? hash : 1;
+}
+
 void ty_add_init(char *name, EagleComplexType *ty)
 {
     hst_put(&init_table, name, ty, NULL, NULL);
@@ -1287,10 +1647,10 @@ LLVMTypeRef ty_get_counted(LLVMTypeRef in)
     if(!ref)
     {
         ref = LLVMStructCreateNamed(utl_get_current_context(), "");
-        LLVMTypeRef tys[6];
+        LLVMTypeRef tys[4];
         LLVMGetStructElementTypes(in, tys);
 
-        LLVMStructSetBody(ref, tys, 6, 0);
+        LLVMStructSetBody(ref, tys, 4, 0);
         hst_put(&counted_table, translated, ref, NULL, NULL);
     }
 
@@ -1299,6 +1659,43 @@ LLVMTypeRef ty_get_counted(LLVMTypeRef in)
     return ref;
 }
 
+// The bookkeeping fields every counted allocation starts with (the
+// __egl_ptr struct of the runtime), without the payload
+LLVMTypeRef ty_counted_header()
+{
+    if(counted_header_type)
+        return counted_header_type;
+
+    LLVMTypeRef tys[3];
+    tys[0] = LLVMInt32TypeInContext(utl_get_current_context());
+    tys[1] = LLVMInt32TypeInContext(utl_get_current_context());
+    tys[2] = LLVMPointerType(ty_type_descriptor(), 0);
+
+    counted_header_type = LLVMStructCreateNamed(utl_get_current_context(), "__egl_ptr_header");
+    LLVMStructSetBody(counted_header_type, tys, 3, 0);
+
+    return counted_header_type;
+}
+
+// What the runtime needs to know about the type of a counted object
+// (__egl_type_desc): only how to tear it down
+LLVMTypeRef ty_type_descriptor()
+{
+    if(type_descriptor_type)
+        return type_descriptor_type;
+
+    LLVMTypeRef ptmp[2];
+    ptmp[0] = LLVMPointerType(LLVMInt8TypeInContext(utl_get_current_context()), 0);
+    ptmp[1] = LLVMInt1TypeInContext(utl_get_current_context());
+
+    LLVMTypeRef teardown = LLVMPointerType(LLVMFunctionType(LLVMVoidTypeInContext(utl_get_current_context()), ptmp, 2, 0), 0);
+
+    type_descriptor_type = LLVMStructCreateNamed(utl_get_current_context(), "__egl_type_desc");
+    LLVMStructSetBody(type_descriptor_type, &teardown, 1, 0);
+
+    return type_descriptor_type;
+}
+
 EagleComplexType *ett_generic_type(char *ident)
 {
     EagleComplexType *ty = hst_get(&generic_ident_table, ident, NULL, NULL);
@@ -1309,6 +1706,7 @@ EagleComplexType *ett_generic_type(char *ident)
     ty->type = ETGeneric;
     ((EagleGenericType *)ty)->ident = ident;
     hst_put(&generic_ident_table, ident, ty, NULL, NULL);
+    hst_put(&placeholder_table, ty, ty, ty_ptr_hash, ty_ptr_equ);
 
     pool_add(&type_mempool, ty);
 
@@ -1322,12 +1720,16 @@ void ty_set_generic_type(char *ident, EagleComplexType *with)
         die(-1, "Unknown generic type: %s", ident);
 
     memcpy(ty, with, ty_size_of_type(with));
+
+    // The placeholder is rebound for every instantiation, so it must not
+    // share the caches of the type it currently stands for
+    ty->info = NULL;
 }
 
 #define TYPE_SIZE_TEST(var, type) if(sizeof(type) > var) var = sizeof(type)
 size_t ty_type_max_size()
 {
-    static size_t max;
+    static EGL_THREAD_LOCAL size_t max;
     if(max)
         return max;
 
@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include "llvm_headers.h"
 #include "arraylist.h"
+#include "config.h"
 
 #define NO_CLOSURE 0
 #define CLOSURE_NO_CLOSE 1
@@ -30,8 +31,15 @@
 #define ET_POINTEE(p) (((EaglePointerType *)(p))->to)
 #define ET_IS_RAW_FUNCTION(p) ((p)->type == ETFunction && !((EagleFunctionType *)(p))->closure)
 
-extern LLVMTargetDataRef etTargetData;
-extern LLVMModuleRef the_module;
+// Counted allocations are laid out as {i32 count, i32 flags, desc*, payload}
+#define ET_COUNTED_DESC 2
+#define ET_COUNTED_PAYLOAD 3
+
+// Counts at or below this belong to objects that are never freed
+#define ET_COUNT_IMMORTAL -5
+
+extern EGL_THREAD_LOCAL LLVMTargetDataRef etTargetData;
+extern EGL_THREAD_LOCAL LLVMModuleRef the_module;
 
 typedef enum {
     ETNone = 0,
@@ -62,12 +70,20 @@ typedef enum {
     ETGeneric
 } EagleBasicType;
 
+// Pointer, array, function and generator types are interned per thread
+// (see ett_pointer_type), and the interned ones carry an info block with
+// their cached LLVM type, size and mangled name. Every other type, and
+// private copies made with ett_copy, leave info NULL.
+struct EagleTypeInfo;
+
 typedef struct {
     EagleBasicType type;
+    struct EagleTypeInfo *info;
 } EagleComplexType;
 
 typedef struct {
     EagleBasicType type;
+    struct EagleTypeInfo *info;
     EagleComplexType *to;
     int counted;
     int weak;
@@ -76,12 +92,14 @@ typedef struct {
 
 typedef struct {
     EagleBasicType type;
+    struct EagleTypeInfo *info;
     EagleComplexType *of;
     int ct;
 } EagleArrayType;
 
 typedef struct {
     EagleBasicType type;
+    struct EagleTypeInfo *info;
     EagleComplexType *retType;
     EagleComplexType **params;
     int pct;
@@ -93,11 +111,13 @@ typedef struct {
 
 typedef struct {
     EagleBasicType type;
+    struct EagleTypeInfo *info;
     EagleComplexType *ytype;
 } EagleGenType;
 
 typedef struct {
     EagleBasicType type;
+    struct EagleTypeInfo *info;
     Arraylist types;
     Arraylist names;
     Arraylist interfaces;
@@ -106,16 +126,19 @@ typedef struct {
 
 typedef struct {
     EagleBasicType type;
+    struct EagleTypeInfo *info;
     Arraylist names;
 } EagleInterfaceType;
 
 typedef struct {
     EagleBasicType type;
+    struct EagleTypeInfo *info;
     char *name;
 } EagleEnumType;
 
 typedef struct {
     EagleBasicType type;
+    struct EagleTypeInfo *info;
     char *ident;
 } EagleGenericType;
 
@@ -125,8 +148,10 @@ EagleBasicType et_eagle_type(LLVMTypeRef ty);
 
 EagleComplexType *ett_base_type(EagleBasicType type);
 EagleComplexType *ett_pointer_type(EagleComplexType *to);
+EagleComplexType *ett_pointer_type_ex(EagleComplexType *to, int counted, int weak, int closed);
 EagleComplexType *ett_array_type(EagleComplexType *of, int ct);
 EagleComplexType *ett_function_type(EagleComplexType *retVal, EagleComplexType **params, int pct);
+EagleComplexType *ett_function_type_ex(EagleComplexType *retVal, EagleComplexType **params, int pct, int closure, int variadic, int gen);
 EagleComplexType *ett_gen_type(EagleComplexType *ytype);
 EagleComplexType *ett_struct_type(char *name);
 EagleComplexType *ett_class_type(char *name);
@@ -152,6 +177,7 @@ void ett_replace_generic_with(EagleComplexType *t, char *gen);
 char *ett_unique_type_name(EagleComplexType *t);
 
 LLVMTypeRef ty_class_indirect();
+LLVMTypeRef ty_class_itable_entry();
 
 void ett_debug_print(EagleComplexType *t);
 
@@ -176,6 +202,8 @@ void ty_struct_member_index(EagleComplexType *ett, char *member, int *index, Eag
 void ty_struct_get_members(EagleComplexType *ett, Arraylist **names, Arraylist **types);
 int ty_needs_destructor(EagleComplexType *ett);
 LLVMTypeRef ty_get_counted(LLVMTypeRef in);
+LLVMTypeRef ty_counted_header();
+LLVMTypeRef ty_type_descriptor();
 void ty_set_typedef(char *name, EagleComplexType *type);
 void ty_add_enum_item(char *name, char *item, long val);
 long ty_lookup_enum_item(EagleComplexType *ty, char *item, int *valid);
@@ -183,6 +211,7 @@ long ty_lookup_enum_item(EagleComplexType *ty, char *item, int *valid);
 void ty_add_interface_method(char *name, char *method, EagleComplexType *ty);
 int ty_interface_offset(char *name, char *method);
 int ty_interface_count(char *name);
+unsigned long ty_interface_id(char *name);
 char *ty_interface_for_method(EagleComplexType *ett, char *method);
 int ty_class_implements_interface(EagleComplexType *type, EagleComplexType *interface);
 void ett_class_set_interfaces(EagleComplexType *ett, Arraylist *interfaces);
@@ -8,13 +8,14 @@
 
 #include "utils.h"
 #include "mempool.h"
+#include "intern.h"
 #include "compiler/ast_compiler.h"
+#include "config.h"
 #include <string.h>
 
 char *utl_gen_escaped_string(char *inp, int lineno)
 {
-    char *n = malloc(strlen(inp) + 1);
-    utl_register_memory(n);
+    char n[strlen(inp) + 1];
     unsigned i, j;
     for(i = j = 0; i < strlen(inp); i++, j++)
     {
@@ -66,11 +67,11 @@ char *utl_gen_escaped_string(char *inp, int lineno)
 
     n[j] = 0;
 
-    return n;
+    return in_intern_len(n, j);
 }
 
-static Mempool utl_mempool;
-static int init_mempool = 0;
+static EGL_THREAD_LOCAL Mempool utl_mempool;
+static EGL_THREAD_LOCAL int init_mempool = 0;
 
 void utl_register_memory(void *m)
 {
@@ -83,12 +84,14 @@ void utl_register_memory(void *m)
     pool_add(&utl_mempool, m);
 }
 
+// Also releases the strings handed out by the lexer
 void utl_free_registered()
 {
     pool_drain(&utl_mempool);
+    in_free();
 }
 
-static LLVMContextRef the_context = NULL;
+static EGL_THREAD_LOCAL LLVMContextRef the_context = NULL;
 void utl_set_current_context(LLVMContextRef ctx)
 {
     the_context = ctx;
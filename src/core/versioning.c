@@ -17,3 +17,8 @@ void print_version_info()
     printf("Compiled:\t" __DATE__ " at " __TIME__ "\n");
 }
 
+const char *ver_build_id()
+{
+    // versioning.c is rebuilt with every compiler build
+    return EGL_VERSION " " __DATE__ " " __TIME__;
+}
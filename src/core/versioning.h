@@ -10,5 +10,6 @@
 #define VERSIONING_H
 
 void print_version_info();
+const char *ver_build_id();
 
 #endif
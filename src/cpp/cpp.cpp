@@ -41,3 +41,26 @@ void EGLEraseFunction(LLVMValueRef func)
 {
     unwrap<llvm::Function>(func)->eraseFromParent();
 }
+
+void EGLSetAlwaysInline(LLVMValueRef func)
+{
+    unwrap<llvm::Function>(func)->addFnAttr(llvm::Attribute::AlwaysInline);
+}
+
+int EGLIsAlwaysInline(LLVMValueRef func)
+{
+    return unwrap<llvm::Function>(func)->hasFnAttribute(llvm::Attribute::AlwaysInline);
+}
+
+// Drops the body or initializer, leaving an external declaration
+void EGLMakeDeclaration(LLVMValueRef global)
+{
+    llvm::GlobalValue *value = unwrap<llvm::GlobalValue>(global);
+
+    if(llvm::Function *func = llvm::dyn_cast<llvm::Function>(value))
+        func->deleteBody();
+    else if(llvm::GlobalVariable *var = llvm::dyn_cast<llvm::GlobalVariable>(value))
+        var->setInitializer(nullptr);
+
+    value->setLinkage(llvm::GlobalValue::ExternalLinkage);
+}
@@ -17,6 +17,9 @@ extern "C" {
 
 LLVMValueRef EGLBuildMalloc(LLVMBuilderRef B, LLVMTypeRef Ty, LLVMValueRef Before, const char *Name);
 void EGLEraseFunction(LLVMValueRef func);
+void EGLSetAlwaysInline(LLVMValueRef func);
+int EGLIsAlwaysInline(LLVMValueRef func);
+void EGLMakeDeclaration(LLVMValueRef global);
 // void EGLGenerateAssembly(LLVMModuleRef module, char *filename);
 
 #ifdef __cplusplus
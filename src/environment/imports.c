@@ -14,6 +14,7 @@
 #include <string.h>
 #include "imports.h"
 #include "exports.h"
+#include "interfaces.h"
 #include "compiler/ast.h"
 #include "grammar/eagle.tab.h"
 #include "core/stringbuilder.h"
@@ -21,26 +22,13 @@
 #include "core/shipping.h"
 #include "core/regex.h"
 #include "core/config.h"
+#include "core/compunit.h"
 
-#define YY_BUF_SIZE 32768
 #define PYES ((void *)(uintptr_t)1)
 #define IS_ID_AND_EQ(tok, text, targ) ((tok) == TIDENTIFIER && strcmp((text), (targ)) == 0)
 
-typedef void* YY_BUFFER_STATE;
-
-extern char *yytext;
-
-extern int skip_type_check;
-extern FILE *yyin;
-extern int yylex();
-extern int yylineno;
-extern YY_BUFFER_STATE yy_create_buffer(FILE*, size_t);
-extern void yypush_buffer_state(YY_BUFFER_STATE);
-extern void yypop_buffer_state();
-
-static Hashtable all_imports;
-static Hashtable imports_exports;
-extern char *current_file_name;
+static EGL_THREAD_LOCAL Hashtable all_imports;
+extern EGL_THREAD_LOCAL char *current_file_name;
 
 typedef struct {
     char *full_text;
@@ -53,13 +41,13 @@ static void imp_iufree(ImportUnit *iu)
     free(iu->symbol);
 }
 
-static void imp_consume_body(Strbuilder *string)
+static void imp_consume_body(CompilationUnit *scan, Strbuilder *string)
 {
     int bracket_depth = 1;
     int token;
     while(bracket_depth)
     {
-        token = yylex();
+        token = cu_lex(scan);
         if(token == TLBRACE)
             bracket_depth++;
         else if(token == TRBRACE)
@@ -67,13 +55,13 @@ static void imp_consume_body(Strbuilder *string)
 
         if(string)
         {
-            sb_append(string, yytext);
+            sb_append(string, cu_text(scan));
             sb_append(string, " ");
         }
     }
 }
 
-static ImportUnit imp_parse_function(int inclass, char *intext, int extdecl)
+static ImportUnit imp_parse_function(CompilationUnit *scan, int inclass, char *intext, int extdecl)
 {
     ImportUnit iu = {NULL, NULL};
 
@@ -86,33 +74,33 @@ static ImportUnit imp_parse_function(int inclass, char *intext, int extdecl)
     sb_append(&string, intext);
     sb_append(&string, " ");
 
-    int token = yylex();
+    int token = cu_lex(scan);
 
     /*
     if(token != TIDENTIFIER)
-        die(yylineno, "%s name not properly defined", intext);
+        die(cu_get_lineno(scan), "%s name not properly defined", intext);
     */
 
-    iu.symbol = strdup(yytext);
+    iu.symbol = strdup(cu_text(scan));
 
     int terminal = extdecl ? TSEMI : TLBRACE;
 
     do 
     {
-        sb_append(&string, yytext);
+        sb_append(&string, cu_text(scan));
         sb_append(&string, " ");
     }
-    while((token = yylex()) != terminal);
+    while((token = cu_lex(scan)) != terminal);
 
     if(!extdecl)
-        imp_consume_body(NULL);
+        imp_consume_body(scan, NULL);
 
     iu.full_text = string.buffer;
 
     return iu;
 }
 
-static ImportUnit imp_parse_typedef()
+static ImportUnit imp_parse_typedef(CompilationUnit *scan)
 {
     ImportUnit iu = {NULL, NULL};
 
@@ -124,13 +112,13 @@ static ImportUnit imp_parse_typedef()
     char *last = NULL;
 
     int token;
-    while((token = yylex()) != TSEMI)
+    while((token = cu_lex(scan)) != TSEMI)
     {
-        sb_append(&string, yytext);
+        sb_append(&string, cu_text(scan));
         sb_append(&string, " ");
         if(last)
             free(last);
-        last = strdup(yytext);
+        last = strdup(cu_text(scan));
     }
 
     iu.full_text = string.buffer;
@@ -139,7 +127,7 @@ static ImportUnit imp_parse_typedef()
     return iu;
 }
 
-static ImportUnit imp_parse_bracketed(int declext, const char *what)
+static ImportUnit imp_parse_bracketed(CompilationUnit *scan, int declext, const char *what)
 {
     ImportUnit iu = {NULL, NULL};
 
@@ -152,18 +140,18 @@ static ImportUnit imp_parse_bracketed(int declext, const char *what)
     sb_append(&string, what);
     sb_append(&string, " ");
 
-    int token = yylex();
+    int token = cu_lex(scan);
     if(token != TIDENTIFIER)
-        die(yylineno, "%s name not properly defined", what);
+        die(cu_get_lineno(scan), "%s name not properly defined", what);
 
-    iu.symbol = strdup(yytext);
+    iu.symbol = strdup(cu_text(scan));
 
-    sb_append(&string, yytext);
+    sb_append(&string, cu_text(scan));
     sb_append(&string, " ");
 
-    while((token = yylex()) != TRBRACE)
+    while((token = cu_lex(scan)) != TRBRACE)
     {
-        sb_append(&string, yytext);
+        sb_append(&string, cu_text(scan));
         sb_append(&string, " ");
     }
 
@@ -174,22 +162,22 @@ static ImportUnit imp_parse_bracketed(int declext, const char *what)
     return iu;
 }
 
-static ImportUnit imp_parse_interface()
+static ImportUnit imp_parse_interface(CompilationUnit *scan)
 {
-    return imp_parse_bracketed(0, "interface");
+    return imp_parse_bracketed(scan, 0, "interface");
 }
 
-static ImportUnit imp_parse_enum()
+static ImportUnit imp_parse_enum(CompilationUnit *scan)
 {
-    return imp_parse_bracketed(0, "enum");
+    return imp_parse_bracketed(scan, 0, "enum");
 }
 
-static ImportUnit imp_parse_struct()
+static ImportUnit imp_parse_struct(CompilationUnit *scan)
 {
-    return imp_parse_bracketed(1, "struct");
+    return imp_parse_bracketed(scan, 1, "struct");
 }
 
-static ImportUnit imp_parse_class(int extdecl)
+static ImportUnit imp_parse_class(CompilationUnit *scan, int extdecl)
 {
     ImportUnit iu = {NULL, NULL};
 
@@ -198,41 +186,41 @@ static ImportUnit imp_parse_class(int extdecl)
 
     sb_append(&string, "extern class ");
 
-    int token = yylex();
+    int token = cu_lex(scan);
     if(token != TIDENTIFIER)
-        die(yylineno, "class name not properly defined");
+        die(cu_get_lineno(scan), "class name not properly defined");
 
-    iu.symbol = strdup(yytext);
+    iu.symbol = strdup(cu_text(scan));
 
     do
     {
-        sb_append(&string, yytext);
+        sb_append(&string, cu_text(scan));
         sb_append(&string, " ");
     }
-    while((token = yylex()) != TLBRACE);
+    while((token = cu_lex(scan)) != TLBRACE);
 
     sb_append(&string, "\n{\n");
     if(extdecl)
     {
-        imp_consume_body(&string);
+        imp_consume_body(scan, &string);
         iu.full_text = string.buffer;
         return iu;
     }
 
-    while((token = yylex()) != TRBRACE)
+    while((token = cu_lex(scan)) != TRBRACE)
     {
         if(token == TFUNC || token == TVIEW ||
-           IS_ID_AND_EQ(token, yytext, "init") ||
-           IS_ID_AND_EQ(token, yytext, "destruct"))
+           IS_ID_AND_EQ(token, cu_text(scan), "init") ||
+           IS_ID_AND_EQ(token, cu_text(scan), "destruct"))
         {
-            ImportUnit u = imp_parse_function(1, yytext, 0);
+            ImportUnit u = imp_parse_function(scan, 1, cu_text(scan), 0);
             sb_append(&string, u.full_text);
 
             imp_iufree(&u);
             continue;
         }
 
-        sb_append(&string, yytext);
+        sb_append(&string, cu_text(scan));
         sb_append(&string, " ");
     }
 
@@ -243,20 +231,46 @@ static ImportUnit imp_parse_class(int extdecl)
     return iu;
 }
 
-static char *imp_scan_file(const char *filename)
+// Lexes a whole file into the unit's token stream
+static void imp_tokenize(CompilationUnit *scan, const char *filename)
+{
+    FILE *f = fopen(filename, "r");
+
+    scan->read_file = 1;
+    cu_open_scanner(scan, f);
+    cu_tokenize(scan);
+    cu_close_scanner(scan);
+    scan->read_file = 0;
+
+    fclose(f);
+}
+
+static char *imp_resolve_path(const char *importer, const char *path)
+{
+    if(path[0] == '/')
+        return realpath(path, NULL);
+
+    char *dup = strdup(importer);
+    char *dir = dirname(dup);
+
+    char joined[strlen(dir) + strlen(path) + 2];
+    sprintf(joined, "%s/%s", dir, path);
+    free(dup);
+
+    return realpath(joined, NULL);
+}
+
+// Rebuilds the declarations the file exports as source text
+static char *imp_extract_exports(CompilationUnit *scan, ExportControl *ec)
 {
     Strbuilder string;
     sb_init(&string);
 
-    FILE *f = fopen(filename, "r");
-    YY_BUFFER_STATE buf = yy_create_buffer(f, YY_BUF_SIZE);
-    yypush_buffer_state(buf);
+    cu_rewind(scan);
     int token, is_extern = 0, save_next = 0;
     ImportUnit iu;
 
-    ExportControl *ec = hst_get(&imports_exports, (char *)filename, NULL, NULL);
-
-    while((token = yylex()) != 0)
+    while((token = cu_lex(scan)) != 0)
     {
         switch(token)
         {
@@ -270,7 +284,7 @@ static char *imp_scan_file(const char *filename)
                 continue;
 
             case TLPAREN:
-                yylex();
+                cu_lex(scan);
                 continue;
 
             case TEXPORT:
@@ -279,25 +293,25 @@ static char *imp_scan_file(const char *filename)
 
             case TFUNC:
             case TGEN:
-                iu = imp_parse_function(0, yytext, is_extern);
+                iu = imp_parse_function(scan, 0, cu_text(scan), is_extern);
                 break;
             case TSTRUCT:
-                iu = imp_parse_struct();
+                iu = imp_parse_struct(scan);
                 break;
             case TCLASS:
-                iu = imp_parse_class(is_extern);
+                iu = imp_parse_class(scan, is_extern);
                 break;
             case TTYPEDEF:
-                iu = imp_parse_typedef();
+                iu = imp_parse_typedef(scan);
                 break;
             case TENUM:
-                iu = imp_parse_enum();
+                iu = imp_parse_enum(scan);
                 break;
             case TINTERFACE:
-                iu = imp_parse_interface();
+                iu = imp_parse_interface(scan);
                 break;
             default:
-                die(yylineno, "Unknown top-level symbol");
+                die(cu_get_lineno(scan), "Unknown top-level symbol");
         }
 
         is_extern = 0;
@@ -311,32 +325,92 @@ static char *imp_scan_file(const char *filename)
         imp_iufree(&iu);
     }
 
-    yypop_buffer_state();
+    cu_rewind(scan);
 
     return string.buffer;
 }
 
-void imp_build_buffer(void *k, void *v, void *data)
+// Collects the import paths as written and the export rules of the file
+static void imp_find_imports(CompilationUnit *scan, Arraylist *paths, ExportControl *ec)
 {
-    Multibuffer *mb = data;
-    char *filename = k;
+    cu_rewind(scan);
+
+    int token;
+    while((token = cu_lex(scan)) != 0)
+    {
+        if(token == TIMPORT)
+            arr_append(paths, strdup(cu_text(scan) + 7));
 
-    char *debgname = malloc(100 + strlen(filename));
-    sprintf(debgname, "<imported from %s>", filename);
+        if(token == TEXPORT && (((token = cu_lex(scan)) == TCSTR) || token == TLPAREN))
+        {
+            int tok = 0;
+            if(token == TLPAREN)
+            {
+                tok = cu_lex(scan);
+                cu_lex(scan);
+                token = cu_lex(scan);
+            }
 
-    char *text = imp_scan_file(filename);
-//    printf("%s\n", text);
-    mb_add_str(mb, text);
-    free(text);
+            char *text = cu_text(scan);
+            char buf[strlen(text) - 2];
+            memcpy(buf, text + 1, strlen(text) - 2);
+            buf[strlen(text) - 2] = '\0';
+            ec_add_wcard(ec, buf, tok);
+        }
+    }
+
+    cu_rewind(scan);
 }
 
-Multibuffer *imp_generate_imports(const char *filename)
+static ModuleInterface *imp_scan_source(CompilationUnit *scan, const char *filename)
 {
-    all_imports = hst_create();
-    imports_exports = hst_create();
-    imports_exports.duplicate_keys = 1;
+    Arraylist paths = arr_create(4);
+    ExportControl *ec = ec_alloc();
+
+    imp_find_imports(scan, &paths, ec);
+    char *text = imp_extract_exports(scan, ec);
+    ec_free(ec);
+
+    return itf_create(filename, text, paths);
+}
+
+// Loads the interface of an imported file from the cache, or lexes the
+// file to build one (and caches that)
+static ModuleInterface *imp_load_interface(const char *filename, const char *dir)
+{
+    ModuleInterface *itf = dir ? itf_load(dir, filename) : NULL;
+    if(itf)
+        return itf;
+
+    CompilationUnit *scan = cu_create(CUFile, (char *)filename);
+    imp_tokenize(scan, filename);
+
+    itf = imp_scan_source(scan, filename);
+    cu_free(scan);
+
+    if(dir)
+        itf_store(dir, filename, itf);
+
+    return itf;
+}
+
+static void imp_collect_interface(void *k, void *v, void *data)
+{
+    arr_append(data, v);
+}
+
+// The importing file is lexed into its unit, where the parser picks up
+// its tokens, and gets its own interface refreshed for the files that
+// import it. Imported files are read through their interfaces, so with a
+// cache directory an unchanged library is neither lexed nor scanned again;
+// its declarations go into the unit's token stream as they were stored.
+// The returned buffer holds the declaration text, for the object cache
+// key and --dump-code.
+Multibuffer *imp_generate_imports(CompilationUnit *unit, const char *dir)
+{
+    const char *filename = unit->filename;
 
-    skip_type_check = 1;
+    all_imports = hst_create();
 
     Arraylist work = arr_create(10);
     int offset = 0;
@@ -349,82 +423,84 @@ Multibuffer *imp_generate_imports(const char *filename)
 
     current_file_name = (char *)filename;
 
-    char *cwd = getcwd(NULL, 0);
     char *current_realpath = realpath(filename, NULL);
-    //printf("%s\n", realpath(filename, NULL));
 
     while(offset < work.count)
     {
         filename = arr_get(&work, offset++);
 
-        ExportControl *ec = ec_alloc();
-
-        FILE *f = fopen(filename, "r");
-
-        YY_BUFFER_STATE buf = yy_create_buffer(f, YY_BUF_SIZE);
-        yypush_buffer_state(buf);
-
-        char *dup = strdup(filename);
-        char *dir = dirname(dup);
-        chdir(dir);
-
-        int token;
-        while((token = yylex()) != 0)
+        Arraylist own = arr_create(4);
+        Arraylist *paths = &own;
+        if(offset == 1)
         {
-            if(token == TIMPORT)
+            imp_tokenize(unit, filename);
+            if(dir && !itf_is_current(dir, filename))
             {
-                char *nw = yytext + 7;
-                char *rp = realpath(nw, NULL);
+                ModuleInterface *mine = imp_scan_source(unit, filename);
+                itf_store(dir, filename, mine);
+                itf_free(mine);
+            }
 
-                if(!rp)
-                    die(-1, "Imported file (%s) does not exist", nw);
+            ExportControl *ec = ec_alloc();
+            imp_find_imports(unit, &own, ec);
+            ec_free(ec);
+        }
+        else
+        {
+            ModuleInterface *itf = imp_load_interface(filename, dir);
+            hst_put(&all_imports, (char *)filename, itf, NULL, NULL);
+            paths = &itf->imports;
+        }
 
-                // Ignore previously viewed files and the current file
-                if(IN(all_imports, rp) || !strcmp(rp, current_realpath))
-                {
-                    free(rp);
-                    continue;
-                }
+        int i;
+        for(i = 0; i < paths->count; i++)
+        {
+            char *nw = arr_get(paths, i);
+            char *rp = imp_resolve_path(filename, nw);
 
-                arr_append(&work, rp);
-                hst_put(&all_imports, rp, PYES, NULL, NULL);
-            }
+            if(!rp)
+                die(-1, "Imported file (%s) does not exist", nw);
 
-            if(token == TEXPORT && (((token = yylex()) == TCSTR) || token == TLPAREN))
+            // Ignore previously viewed files and the current file
+            if(IN(all_imports, rp) || !strcmp(rp, current_realpath))
             {
-                int tok = 0;
-                if(token == TLPAREN)
-                {
-                    tok = yylex();
-                    yylex();
-                    token = yylex();
-                }
-
-                char buf[strlen(yytext) - 2];
-                memcpy(buf, yytext + 1, strlen(yytext) - 2);
-                buf[strlen(yytext) - 2] = '\0';
-                ec_add_wcard(ec, buf, tok);
+                free(rp);
+                continue;
             }
-        }
 
-        yypop_buffer_state();
+            arr_append(&work, rp);
+            hst_put(&all_imports, rp, PYES, NULL, NULL);
+        }
 
-        char *rp = realpath(filename, NULL);
-        hst_put(&imports_exports, rp, ec, NULL, NULL);
-        free(rp);
+        for(i = 0; i < own.count; i++)
+            free(arr_get(&own, i));
+        arr_free(&own);
     }
 
-    // exit(0);
-
-    chdir(cwd);
-    free(cwd);
     free(current_realpath);
 
+    Arraylist interfaces = arr_create(10);
+    hst_for_each(&all_imports, imp_collect_interface, &interfaces);
+    hst_free(&all_imports);
+
+    int i;
+    for(i = 0; i < work.count; i++)
+        free(arr_get(&work, i));
+    arr_free(&work);
+
     Multibuffer *buf = mb_alloc();
-    hst_for_each(&all_imports, imp_build_buffer, buf);
-    skip_type_check = 0;
+    for(i = 0; i < interfaces.count; i++)
+        mb_add_str(buf, ((ModuleInterface *)arr_get(&interfaces, i))->text);
+
+    // Prepended last to first, so the tokens follow the order of the text
+    for(i = interfaces.count - 1; i >= 0; i--)
+    {
+        ModuleInterface *itf = arr_get(&interfaces, i);
+        cu_prepend(unit, itf->decls);
+        itf_free(itf);
+    }
 
-    hst_free(&imports_exports);
+    arr_free(&interfaces);
 
     return buf;
 }
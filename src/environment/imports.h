@@ -10,7 +10,8 @@
 #define IMPORTS_H
 
 #include "core/multibuffer.h"
+#include "core/compunit.h"
 
-Multibuffer *imp_generate_imports(const char *filename);
+Multibuffer *imp_generate_imports(CompilationUnit *unit, const char *dir);
 
 #endif
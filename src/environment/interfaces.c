@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "interfaces.h"
+#include "core/buildcache.h"
+#include "core/threading.h"
+#include "core/versioning.h"
+
+// An .egli file holds, in order: a header naming the compiler build and
+// the version of the source it was made from, the declaration text, the
+// import paths and the lexed declarations. Sources are told apart by
+// modification time and size, falling back to a hash of their contents
+// when only the time changed.
+
+#define ITF_MAGIC "EGLI"
+#define ITF_FORMAT 1
+#define ITF_MAX_STR (1 << 24)
+#define CHUNK 4096
+
+typedef struct {
+    long long mtime;
+    long long size;
+    char hash[BC_KEY_LEN + 1];
+} ItfStamp;
+
+static char *itf_path(const char *dir, const char *source)
+{
+    BCHash h;
+    bc_hash_init(&h);
+    bc_hash_str(&h, source);
+
+    char key[BC_KEY_LEN + 1];
+    bc_hash_hex(&h, key);
+
+    char *path = malloc(strlen(dir) + BC_KEY_LEN + 7);
+    sprintf(path, "%s/%s.egli", dir, key);
+
+    return path;
+}
+
+static int itf_stat(const char *source, ItfStamp *stamp)
+{
+    struct stat st;
+    if(stat(source, &st) < 0)
+        return 0;
+
+    stamp->mtime = st.st_mtime;
+    stamp->size = st.st_size;
+    stamp->hash[0] = '\0';
+
+    return 1;
+}
+
+static int itf_hash(const char *source, ItfStamp *stamp)
+{
+    FILE *f = fopen(source, "rb");
+    if(!f)
+        return 0;
+
+    BCHash h;
+    bc_hash_init(&h);
+
+    char chunk[CHUNK];
+    size_t read;
+    while((read = fread(chunk, 1, CHUNK, f)) > 0)
+        bc_hash_update(&h, chunk, read);
+    fclose(f);
+
+    bc_hash_hex(&h, stamp->hash);
+    return 1;
+}
+
+static void itf_write_str(FILE *f, const char *str)
+{
+    int len = strlen(str);
+    fwrite(&len, sizeof(int), 1, f);
+    fwrite(str, 1, len, f);
+}
+
+static char *itf_read_str(FILE *f)
+{
+    int len;
+    if(fread(&len, sizeof(int), 1, f) != 1 || len < 0 || len > ITF_MAX_STR)
+        return NULL;
+
+    char *str = malloc(len + 1);
+    if(fread(str, 1, len, f) != (size_t)len)
+    {
+        free(str);
+        return NULL;
+    }
+
+    str[len] = '\0';
+    return str;
+}
+
+// Returns the interface file positioned after its header, or NULL if there
+// is none for this build and this version of the source
+static FILE *itf_open(const char *dir, const char *source)
+{
+    ItfStamp now;
+    if(!itf_stat(source, &now))
+        return NULL;
+
+    char *path = itf_path(dir, source);
+    FILE *f = fopen(path, "rb");
+    free(path);
+
+    if(!f)
+        return NULL;
+
+    char magic[4];
+    int format;
+    ItfStamp then;
+    char *build = NULL;
+
+    int ok = fread(magic, 1, 4, f) == 4 && !memcmp(magic, ITF_MAGIC, 4) &&
+             fread(&format, sizeof(int), 1, f) == 1 && format == ITF_FORMAT &&
+             (build = itf_read_str(f)) && !strcmp(build, ver_build_id()) &&
+             fread(&then, sizeof(ItfStamp), 1, f) == 1 && then.size == now.size;
+
+    if(ok && then.mtime != now.mtime)
+        ok = itf_hash(source, &now) && !strcmp(then.hash, now.hash);
+
+    free(build);
+    if(!ok)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    return f;
+}
+
+ModuleInterface *itf_create(const char *source, char *text, Arraylist imports)
+{
+    ModuleInterface *itf = malloc(sizeof(ModuleInterface));
+    itf->text = text;
+    itf->imports = imports;
+
+    CompilationUnit *decls = cu_create(CUString, (char *)source);
+    decls->buffer = mb_alloc();
+    mb_add_str(decls->buffer, text);
+
+    cu_open_scanner(decls, NULL);
+    cu_tokenize(decls);
+    cu_close_scanner(decls);
+
+    itf->decls = decls;
+
+    return itf;
+}
+
+ModuleInterface *itf_load(const char *dir, const char *source)
+{
+    FILE *f = itf_open(dir, source);
+    if(!f)
+        return NULL;
+
+    ModuleInterface *itf = malloc(sizeof(ModuleInterface));
+    itf->imports = arr_create(4);
+    itf->decls = cu_create(CUString, (char *)source);
+
+    int ok = (itf->text = itf_read_str(f)) != NULL;
+
+    int count = 0;
+    ok = ok && fread(&count, sizeof(int), 1, f) == 1;
+
+    int i;
+    for(i = 0; ok && i < count; i++)
+    {
+        char *path = itf_read_str(f);
+        if(path)
+            arr_append(&itf->imports, path);
+        ok = path != NULL;
+    }
+
+    ok = ok && cu_read_tokens(itf->decls, f);
+    fclose(f);
+
+    if(!ok)
+    {
+        itf_free(itf);
+        return NULL;
+    }
+
+    return itf;
+}
+
+int itf_is_current(const char *dir, const char *source)
+{
+    FILE *f = itf_open(dir, source);
+    if(!f)
+        return 0;
+
+    fclose(f);
+    return 1;
+}
+
+void itf_store(const char *dir, const char *source, ModuleInterface *itf)
+{
+    ItfStamp stamp;
+    if(!itf_stat(source, &stamp) || !itf_hash(source, &stamp))
+        return;
+
+    char *path = itf_path(dir, source);
+
+    // Written next to the entry and renamed, as bc_store does for objects
+    char *temp = malloc(strlen(path) + 50);
+    sprintf(temp, "%s.%ld.%d.tmp", path, (long)getpid(), thr_request_number());
+
+    FILE *f = fopen(temp, "wb");
+    if(!f)
+    {
+        free(temp);
+        free(path);
+        return;
+    }
+
+    int format = ITF_FORMAT;
+    fwrite(ITF_MAGIC, 1, 4, f);
+    fwrite(&format, sizeof(int), 1, f);
+    itf_write_str(f, ver_build_id());
+    fwrite(&stamp, sizeof(ItfStamp), 1, f);
+
+    itf_write_str(f, itf->text);
+
+    int count = itf->imports.count;
+    fwrite(&count, sizeof(int), 1, f);
+
+    int i;
+    for(i = 0; i < count; i++)
+        itf_write_str(f, arr_get(&itf->imports, i));
+
+    cu_write_tokens(itf->decls, f);
+
+    if(fclose(f) != 0 || rename(temp, path) < 0)
+        unlink(temp);
+
+    free(temp);
+    free(path);
+}
+
+void itf_free(ModuleInterface *itf)
+{
+    int i;
+    for(i = 0; i < itf->imports.count; i++)
+        free(arr_get(&itf->imports, i));
+    arr_free(&itf->imports);
+
+    cu_free(itf->decls);
+    free(itf->text);
+    free(itf);
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2015-2016 Sam Horlbeck Olsen
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef INTERFACES_H
+#define INTERFACES_H
+
+#include "core/arraylist.h"
+#include "core/compunit.h"
+
+// What importing a source brings in: the declarations it exports, already
+// lexed, and the import paths it names in turn. The declaration text is
+// kept for the object cache key and --dump-code.
+typedef struct {
+    char *text;
+    Arraylist imports;
+    CompilationUnit *decls;
+} ModuleInterface;
+
+ModuleInterface *itf_create(const char *source, char *text, Arraylist imports);
+ModuleInterface *itf_load(const char *dir, const char *source);
+int itf_is_current(const char *dir, const char *source);
+void itf_store(const char *dir, const char *source, ModuleInterface *itf);
+void itf_free(ModuleInterface *itf);
+
+#endif
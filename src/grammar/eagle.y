@@ -14,13 +14,18 @@
     extern int pipe_lex();
     extern void pipe_reset_context();
     #define yylex pipe_lex
-    extern int yyerror(const char *);
-
-    AST *ast_root = NULL;
+    extern int yyerror(yyscan_t, const char *);
 %}
 
+%code requires {
+    #include "core/compunit.h"
+}
+
 %error-verbose
 %expect 6
+%define api.pure full
+%lex-param {yyscan_t scanner}
+%parse-param {yyscan_t scanner}
 
 %union {
     int token;
@@ -76,8 +81,8 @@
 
 %%
 
-start               : T_PARSE_PROGRAM declarations { ast_root = $2; }
-                    | T_PARSE_EXPRESSION statement { ast_root = $2; }
+start               : T_PARSE_PROGRAM declarations { cu_from_scanner(scanner)->ast_root = $2; }
+                    | T_PARSE_EXPRESSION statement { cu_from_scanner(scanner)->ast_root = $2; }
                     ;
 
 declarations        : declaration { if($1) $$ = $1; else $$ = NULL; }
@@ -204,7 +209,7 @@ initdecl            : TIDENTIFIER TLPAREN TRPAREN block { $$ = ast_make_class_sp
                     | TIDENTIFIER TLPAREN vardecllist TRPAREN TSEMI { $$ = ast_make_class_special_decl($1, NULL, $3); }
                     ;
 
-funcdecl            : funcident block { ((ASTFuncDecl *)$1)->body = $2; $$ = $1; pipe_reset_context(); };
+funcdecl            : funcident block { ((ASTFuncDecl *)$1)->body = $2; $$ = $1; pipe_reset_context(scanner); };
 
 gendecl             : genident block { ((ASTFuncDecl *)$1)->body = $2; $$ = $1; };
 
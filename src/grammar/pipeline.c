@@ -1,16 +1,14 @@
 #include "compiler/ast.h"
 #include "eagle.tab.h"
 #include "core/hashtable.h"
+#include "core/compunit.h"
+#include "core/types.h"
 
-#define LOOKBACK 3
+#define LOOKBACK CU_LOOKBACK
 #define PLACE_HOLDER (void *)(1)
 
-extern int yylex();
-extern char *yytext;
+int pipe_is_type(char *txt);
 
-static int in_type_context;
-static Hashtable type_names;
-static int initialize_type_names = 1;
 
 static void pipe_shift(int *arr, int tok, int ct)
 {
@@ -28,52 +26,57 @@ static int pipe_matches(int *arr1, int *arr2, int ct)
     return 1;
 }
 
-static void pipe_prepare_type_names()
+static void pipe_prepare_type_names(CompilationUnit *unit)
 {
-    if(initialize_type_names)
-    {
-        type_names = hst_create();
-        type_names.duplicate_keys = 1;
-        initialize_type_names = 0;
-        return;
-    }
+    hst_free(&unit->type_names);
+    unit->type_names = hst_create();
+    unit->type_names.duplicate_keys = 1;
+}
+
+// The lexer leaves every name as an identifier; whether it names a type
+// is decided here, when the token reaches the parser
+static int pipe_next(CompilationUnit *unit, YYSTYPE *lval)
+{
+    int tok = cu_next(unit, lval);
+    if(tok == TIDENTIFIER && (ty_is_name(lval->string) || pipe_is_type(lval->string)))
+        return TTYPE;
 
-    hst_free(&type_names);
-    type_names = hst_create();
-    type_names.duplicate_keys = 1;
+    return tok;
 }
 
-static void pipe_read_typenames()
+static void pipe_read_typenames(YYSTYPE *lval, yyscan_t scanner)
 {
+    CompilationUnit *unit = cu_from_scanner(scanner);
     int tok;
 
-    while((tok = yylex()) != TGT)
+    while((tok = pipe_next(unit, lval)) != TGT)
     {
         if(tok == TIDENTIFIER)
         {
-            hst_put(&type_names, yytext, PLACE_HOLDER, NULL, NULL);
+            hst_put(&unit->type_names, lval->string, PLACE_HOLDER, NULL, NULL);
         }
     }
 }
 
-int pipe_lex()
+int pipe_lex(YYSTYPE *lval, yyscan_t scanner)
 {
-    static int previous_tokens[LOOKBACK];
     static int target_tokens[] = {
         TFUNC,
         TIDENTIFIER,
         TLT
     };
 
-    int tok = yylex();
-    pipe_shift(previous_tokens, tok, LOOKBACK);
+    CompilationUnit *unit = cu_from_scanner(scanner);
 
-    if(pipe_matches(previous_tokens, target_tokens, LOOKBACK))
+    int tok = pipe_next(unit, lval);
+    pipe_shift(unit->previous_tokens, tok, LOOKBACK);
+
+    if(pipe_matches(unit->previous_tokens, target_tokens, LOOKBACK))
     {
-        pipe_prepare_type_names();
-        pipe_read_typenames();
-        in_type_context = 1;
-        return yylex();
+        pipe_prepare_type_names(unit);
+        pipe_read_typenames(lval, scanner);
+        unit->in_type_context = 1;
+        return pipe_next(unit, lval);
     }
     else if(tok == TMACRO)
     {
@@ -85,14 +88,14 @@ int pipe_lex()
 
 int pipe_is_type(char *txt)
 {
-    if(!in_type_context)
+    CompilationUnit *unit = cu_current();
+    if(!unit || !unit->in_type_context)
         return 0;
 
-    return (int)(uintptr_t)hst_get(&type_names, txt, NULL, NULL);
+    return (int)(uintptr_t)hst_get(&unit->type_names, txt, NULL, NULL);
 }
 
-void pipe_reset_context()
+void pipe_reset_context(yyscan_t scanner)
 {
-    in_type_context = 0;
+    cu_from_scanner(scanner)->in_type_context = 0;
 }
-